@@ -0,0 +1,103 @@
+// Times every intersection kernel on random sorted doc-id lists, one row per
+// length ratio, so galloping_ratio and the merge kernels can be checked on a
+// given CPU.
+//
+//   cmake -S . -B build -DRETORT_BUILD_BENCH=ON && cmake --build build
+//   build/retort_posting_bench [large list length] [documents]
+#include "search/posting_kernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace retort;
+
+namespace
+{
+std::vector<std::uint32_t> random_list(std::mt19937_64 &rng, std::size_t size, std::uint32_t documents) {
+    std::vector<std::uint32_t> list;
+    list.reserve(size);
+    std::uniform_int_distribution<std::uint32_t> doc(0U, documents - 1U);
+    while (list.size() < size) {
+        list.push_back(doc(rng));
+        if (list.size() == size) {
+            std::sort(list.begin(), list.end());
+            list.erase(std::unique(list.begin(), list.end()), list.end());
+        }
+    }
+    return list;
+}
+
+// Best of several runs, in microseconds.
+template <typename Kernel>
+double time_kernel(Kernel kernel, std::size_t &matches) {
+    double best = 0.0;
+    for (int run = 0; run < 7; ++run) {
+        const auto start = std::chrono::steady_clock::now();
+        matches = kernel();
+        const std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+        best = run == 0 ? elapsed.count() : std::min(best, elapsed.count());
+    }
+    return best;
+}
+}
+
+int main(int argc, char **argv) {
+    try {
+        const std::size_t large_size = argc > 1 ? std::stoull(argv[1]) : 1000000U;
+        const auto documents = static_cast<std::uint32_t>(argc > 2 ? std::stoull(argv[2]) : large_size * 4U);
+        if (large_size == 0U || documents < large_size) {
+            std::fprintf(stderr, "usage: retort_posting_bench [large list length] [documents >= length]\n");
+            return 2;
+        }
+
+        std::mt19937_64 rng{42U};
+        const auto large = random_list(rng, large_size, documents);
+        const auto best = best_intersect_kernel();
+        std::printf("%zu ids out of %u documents, best kernel %s, times in us\n", large.size(), documents,
+                    kernel_name(best));
+        std::printf("%8s %8s %10s %10s %10s %10s %10s %10s\n", "ratio", "matches", "scalar", "sse42", "avx2",
+                    "galloping", "sorted", "fastest");
+
+        for (const std::size_t ratio : {1U, 4U, 16U, 64U, 128U, 256U, 1024U, 4096U}) {
+            const auto small = random_list(rng, std::max<std::size_t>(large.size() / ratio, 1U), documents);
+            std::vector<std::uint32_t> out(small.size());
+            std::size_t matches = 0U;
+            double times[5]{};
+            const intersect_kernel merges[] = {intersect_kernel::scalar, intersect_kernel::sse42, intersect_kernel::avx2};
+            for (std::size_t k = 0U; k < 3U; ++k) {
+                times[k] = merges[k] > best ? 0.0 : time_kernel([&] {
+                    return intersect_merge(merges[k], small.data(), small.size(), large.data(), large.size(), out.data());
+                }, matches);
+            }
+            times[3] = time_kernel([&] {
+                return intersect_galloping(small.data(), small.size(), large.data(), large.size(), out.data());
+            }, matches);
+            times[4] = time_kernel([&] {
+                return intersect_sorted(small.data(), small.size(), large.data(), large.size(), out.data());
+            }, matches);
+
+            const char *fastest = times[3] < times[static_cast<std::size_t>(best)] ? "galloping" : kernel_name(best);
+            std::printf("%8zu %8zu", ratio, matches);
+            for (const auto time : times) {
+                if (time == 0.0) {
+                    std::printf(" %10s", "-");
+                }
+                else {
+                    std::printf(" %10.1f", time);
+                }
+            }
+            std::printf(" %10s\n", fastest);
+        }
+        return 0;
+    }
+    catch (const std::exception &error) {
+        std::fprintf(stderr, "retort_posting_bench: %s\n", error.what());
+        return 1;
+    }
+}
@@ -0,0 +1,95 @@
+// Feeds random user input through make_match_expression and runs every
+// resulting expression against an index, failing when sqlite3_step does.
+//
+//   cmake -S . -B build -DRETORT_BUILD_FUZZ=ON && cmake --build build
+//   build/retort_query_fuzz index.sqlite 200000
+#include "index/sqlite_database.h"
+#include "search/term_dictionary.h"
+#include "util/text_normalizer.h"
+
+#include <cstdio>
+#include <exception>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace retort;
+
+namespace
+{
+// Fragments that exercise FTS5 syntax, operators, quoting and broken UTF-8.
+const std::string fragments[] = {
+    "\"", "*", "(", ")", ":", "^", "+", "-", "{", "}", "AND", "OR", "NOT", "NEAR", "NEAR(", " ", " ", "\t",
+    "a", "ka", "ri", "mon", "\xe6\x9d\xb1", "\xe4\xba\xac", "\xff", "\x80", "\xc3", "title:", "C++",
+    "git-branch", "%", "'", ",", ".", std::string(1, '\0'), "0", "9", "\xef\xbc\xa1"};
+
+std::string random_input(std::mt19937_64 &rng) {
+    std::string input;
+    const auto parts = rng() % 8U + 1U;
+    for (std::size_t part = 0U; part < parts; ++part) {
+        if (rng() % 4U == 0U) {
+            input.push_back(static_cast<char>(rng() % 256U));
+        }
+        else {
+            input += fragments[rng() % std::size(fragments)];
+        }
+    }
+    return input;
+}
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::fprintf(stderr, "usage: retort_query_fuzz <index.sqlite> [iterations] [seed]\n");
+        return 2;
+    }
+    try {
+        const long iterations = argc > 2 ? std::stol(argv[2]) : 100000L;
+        std::mt19937_64 rng{argc > 3 ? std::stoull(argv[3]) : 42ULL};
+        sqlite_database database{argv[1], SQLITE_OPEN_READONLY};
+        sqlite3_stmt *stmt = nullptr;
+        const char *sql =
+            "SELECT rowid, snippet(docs_fts, 1, '<', '>', '...', 8) FROM docs_fts"
+            " WHERE docs_fts MATCH ? ORDER BY rank LIMIT 3";
+        if (sqlite3_prepare_v2(database.handle(), sql, -1, &stmt, nullptr) != SQLITE_OK) {
+            std::fprintf(stderr, "failed to prepare: %s\n", sqlite3_errmsg(database.handle()));
+            return 2;
+        }
+
+        const std::vector<std::size_t> no_prefix_index;
+        const std::vector<std::size_t> prefix_index{2U, 3U};
+        // Every other pair of iterations caps prefixes like --prefix-fanout.
+        const term_dictionary dictionary{database.handle()};
+        const prefix_cap cap = [&dictionary](std::string_view prefix) {
+            return dictionary.top_expansions(prefix, 4U);
+        };
+        long searched = 0L;
+        long failures = 0L;
+        for (long i = 0L; i < iterations; ++i) {
+            const auto input = random_input(rng);
+            const auto expression = make_match_expression(input,
+                                                          (i & 1L) != 0L ? prefix_index : no_prefix_index,
+                                                          (i & 2L) != 0L ? cap : prefix_cap{});
+            if (expression.empty()) {
+                continue;
+            }
+            ++searched;
+            sqlite3_reset(stmt);
+            sqlite3_bind_text(stmt, 1, expression.data(), static_cast<int>(expression.size()), SQLITE_TRANSIENT);
+            int step = SQLITE_ROW;
+            while ((step = sqlite3_step(stmt)) == SQLITE_ROW) {
+            }
+            if (step != SQLITE_DONE && ++failures <= 10L) {
+                std::printf("failed: [%s] %s\n", expression.c_str(), sqlite3_errmsg(database.handle()));
+            }
+        }
+        sqlite3_finalize(stmt);
+        std::printf("iterations=%ld searched=%ld failures=%ld\n", iterations, searched, failures);
+        return failures == 0L ? 0 : 1;
+    }
+    catch (const std::exception &ex) {
+        std::fprintf(stderr, "retort_query_fuzz: %s\n", ex.what());
+        return 2;
+    }
+}
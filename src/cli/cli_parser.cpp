@@ -36,6 +36,15 @@ int parse_int(std::string_view value) {
     return number;
 }
 
+double parse_double(std::string_view value) {
+    double number = 0.0;
+    const auto result = std::from_chars(value.data(), value.data() + value.size(), number);
+    if (result.ec != std::errc{} || result.ptr != value.data() + value.size() || !(number >= 0.0)) {
+        throw std::runtime_error("invalid numeric value: " + std::string{value});
+    }
+    return number;
+}
+
 std::optional<std::string> read_env_optional(std::string_view name) {
     const auto value = get_env(name);
     if (value.has_value() && value->empty()) {
@@ -52,6 +61,69 @@ std::size_t read_env_size(std::string_view name, std::size_t fallback) {
     return parse_size(*value);
 }
 
+double read_env_double(std::string_view name, double fallback) {
+    const auto value = get_env(name);
+    if (!value.has_value()) {
+        return fallback;
+    }
+    return parse_double(*value);
+}
+
+search_engine parse_engine(std::string_view value) {
+    if (value == "sqlite") {
+        return search_engine::sqlite;
+    }
+    if (value == "memory") {
+        return search_engine::memory;
+    }
+    throw std::runtime_error("invalid engine: " + std::string{value});
+}
+
+index_format parse_format(std::string_view value) {
+    if (value == "sqlite") {
+        return index_format::sqlite;
+    }
+    if (value == "segment") {
+        return index_format::segment;
+    }
+    throw std::runtime_error("invalid format: " + std::string{value});
+}
+
+text_tokenizer parse_tokenizer(std::string_view value) {
+    if (value == "unicode61") {
+        return text_tokenizer::unicode61;
+    }
+    if (value == "cjk") {
+        return text_tokenizer::cjk;
+    }
+    throw std::runtime_error("invalid tokenizer: " + std::string{value});
+}
+
+// "2 3 4" or "2,3,4": the prefix lengths FTS5 keeps a prefix index for.
+std::vector<std::size_t> parse_prefix_index(std::string_view value) {
+    std::vector<std::size_t> lengths;
+    std::size_t pos = 0U;
+    while (pos < value.size()) {
+        const auto begin = value.find_first_not_of(" ,", pos);
+        if (begin == std::string_view::npos) {
+            break;
+        }
+        auto end = value.find_first_of(" ,", begin);
+        if (end == std::string_view::npos) {
+            end = value.size();
+        }
+        const auto length = parse_size(value.substr(begin, end - begin));
+        if (length == 0U || length > 999U) {
+            throw std::runtime_error("invalid prefix index length: " + std::string{value.substr(begin, end - begin)});
+        }
+        lengths.push_back(length);
+        pos = end;
+    }
+    std::sort(lengths.begin(), lengths.end());
+    lengths.erase(std::unique(lengths.begin(), lengths.end()), lengths.end());
+    return lengths;
+}
+
 std::string take_value(int &index, int argc, char **argv) {
     const int target = index + 1;
     if (target >= argc) {
@@ -83,6 +155,14 @@ cli_result parse_cli(int argc, char **argv) {
         config.default_limit = read_env_size("RETORT_DEFAULT_LIMIT", config.default_limit);
         config.max_query_length = read_env_size("RETORT_MAX_Q_LEN", config.max_query_length);
         config.log_level = get_env_or("RETORT_LOG_LEVEL", config.log_level);
+        const auto env_engine = read_env_optional("RETORT_ENGINE");
+        if (env_engine.has_value()) {
+            config.engine = parse_engine(*env_engine);
+        }
+        config.ranking.title_weight = read_env_double("RETORT_TITLE_WEIGHT", config.ranking.title_weight);
+        config.ranking.body_weight = read_env_double("RETORT_BODY_WEIGHT", config.ranking.body_weight);
+        config.ranking.recency_boost = read_env_double("RETORT_RECENCY_BOOST", config.ranking.recency_boost);
+        config.ranking.recency_half_life_days = read_env_double("RETORT_RECENCY_HALF_LIFE", config.ranking.recency_half_life_days);
 
         for (int i = 2; i < argc; ++i) {
             const std::string arg{argv[i]};
@@ -114,6 +194,21 @@ cli_result parse_cli(int argc, char **argv) {
             else if (arg == "--log_level") {
                 config.log_level = take_value(i, argc, argv);
             }
+            else if (arg == "--engine") {
+                config.engine = parse_engine(take_value(i, argc, argv));
+            }
+            else if (arg == "--title_weight") {
+                config.ranking.title_weight = parse_double(take_value(i, argc, argv));
+            }
+            else if (arg == "--body_weight") {
+                config.ranking.body_weight = parse_double(take_value(i, argc, argv));
+            }
+            else if (arg == "--recency_boost") {
+                config.ranking.recency_boost = parse_double(take_value(i, argc, argv));
+            }
+            else if (arg == "--recency_half_life") {
+                config.ranking.recency_half_life_days = parse_double(take_value(i, argc, argv));
+            }
             else {
                 throw std::runtime_error("unknown option: " + arg);
             }
@@ -122,6 +217,12 @@ cli_result parse_cli(int argc, char **argv) {
         if (config.index_path.empty()) {
             throw std::runtime_error("--index_path or RETORT_INDEX_PATH is required");
         }
+        if (config.ranking.recency_half_life_days <= 0.0) {
+            throw std::runtime_error("--recency_half_life must be positive");
+        }
+        if (!config.ranking.is_default() && config.engine == search_engine::memory) {
+            throw std::runtime_error("custom ranking is not supported by the memory engine");
+        }
 
         if (config.default_limit == 0U || config.default_limit > config.max_limit) {
             config.default_limit = std::min<std::size_t>(20U, config.max_limit);
@@ -159,6 +260,30 @@ cli_result parse_cli(int argc, char **argv) {
             else if (arg == "--max-bytes") {
                 config.max_bytes = parse_size(take_value(i, argc, argv));
             }
+            else if (arg == "--watch") {
+                config.watch = true;
+            }
+            else if (arg == "--shards") {
+                config.shard_count = parse_size(take_value(i, argc, argv));
+            }
+            else if (arg == "--format") {
+                config.format = parse_format(take_value(i, argc, argv));
+            }
+            else if (arg == "--prefix-fanout") {
+                config.prefix_fanout = parse_size(take_value(i, argc, argv));
+            }
+            else if (arg == "--prefix-index") {
+                config.prefix_index = parse_prefix_index(take_value(i, argc, argv));
+            }
+            else if (arg == "--tokenizer") {
+                config.tokenizer = parse_tokenizer(take_value(i, argc, argv));
+            }
+            else if (arg == "--trigram") {
+                config.trigram = true;
+            }
+            else if (arg == "--hot-prefixes") {
+                config.hot_prefix_hits = parse_size(take_value(i, argc, argv));
+            }
             else {
                 throw std::runtime_error("unknown option: " + arg);
             }
@@ -167,6 +292,29 @@ cli_result parse_cli(int argc, char **argv) {
         if (config.source_directory.empty() && config.repository_root.empty()) {
             throw std::runtime_error("--src_dir or --repo is required");
         }
+        if (config.shard_count == 0U) {
+            throw std::runtime_error("--shards must be at least 1");
+        }
+        if (config.watch && config.shard_count > 1U) {
+            throw std::runtime_error("--watch cannot be combined with --shards");
+        }
+        if (config.watch && config.format == index_format::segment) {
+            throw std::runtime_error("--watch requires --format sqlite; segments are immutable");
+        }
+        if (config.trigram && config.format == index_format::segment) {
+            throw std::runtime_error("--trigram requires --format sqlite");
+        }
+        if (config.ngram_size.has_value() && config.tokenizer == text_tokenizer::cjk) {
+            throw std::runtime_error("--ngram cannot be combined with --tokenizer cjk");
+        }
+        if (config.hot_prefix_hits > 0U && (config.watch || config.shard_count > 1U || config.format == index_format::segment)) {
+            throw std::runtime_error("--hot-prefixes requires a single sqlite index without --watch");
+        }
+        // Pages past the stored hits come from the uncapped SQLite search, so
+        // capped stored hits would rank the same prefix two ways.
+        if (config.hot_prefix_hits > 0U && config.prefix_fanout > 0U) {
+            throw std::runtime_error("--hot-prefixes cannot be combined with --prefix-fanout");
+        }
 
         cli_result result{};
         result.command = command_type::write;
@@ -4,6 +4,7 @@
 #include <optional>
 #include <string>
 #include <string_view>
+#include <vector>
 
 namespace retort
 {
@@ -13,6 +14,39 @@ enum class command_type
     write
 };
 
+enum class search_engine
+{
+    sqlite,
+    memory
+};
+
+enum class index_format
+{
+    sqlite,
+    segment
+};
+
+enum class text_tokenizer
+{
+    unicode61,
+    cjk
+};
+
+// How /search orders hits. bm25 column weights for title and body, and a
+// multiplier of 1 + recency_boost * 0.5^(age / half life) on the score,
+// with age taken from docs.updated_at. The defaults are FTS5's own order.
+struct ranking_config
+{
+    double title_weight = 1.0;
+    double body_weight = 1.0;
+    double recency_boost = 0.0;
+    double recency_half_life_days = 30.0;
+
+    bool is_default() const noexcept {
+        return title_weight == 1.0 && body_weight == 1.0 && recency_boost == 0.0;
+    }
+};
+
 struct serve_config
 {
     std::string listen_address = "127.0.0.1:9000";
@@ -24,6 +58,8 @@ struct serve_config
     std::size_t max_limit = 100U;
     std::size_t max_query_length = 1024U;
     std::string log_level = "info";
+    search_engine engine = search_engine::sqlite;
+    ranking_config ranking;
 };
 
 struct write_config
@@ -34,6 +70,14 @@ struct write_config
     bool include_code_blocks = false;
     std::optional<int> ngram_size;
     std::size_t max_bytes = 1024U * 1024U;
+    bool watch = false;
+    std::size_t shard_count = 1U;
+    index_format format = index_format::sqlite;
+    text_tokenizer tokenizer = text_tokenizer::unicode61;
+    std::size_t prefix_fanout = 0U;
+    std::vector<std::size_t> prefix_index;
+    std::size_t hot_prefix_hits = 0U;
+    bool trigram = false;
 };
 
 struct cli_result
@@ -0,0 +1,162 @@
+#include "cjk_tokenizer.h"
+
+#include "index/fts5_tokenizer.h"
+
+#include <new>
+#include <stdexcept>
+#include <string>
+
+namespace retort
+{
+namespace
+{
+using token_callback = int (*)(void *, int, const char *, int, int, int);
+
+struct cjk_tokenizer
+{
+    fts5_tokenizer words{};
+    Fts5Tokenizer *word_tokenizer = nullptr;
+};
+
+// Forwards unicode61 tokens of a slice with offsets into the whole text.
+struct word_context
+{
+    void *context;
+    token_callback callback;
+    int base;
+};
+
+int forward_word(void *context, int flags, const char *token, int size, int start, int end) {
+    const auto *words = static_cast<const word_context *>(context);
+    return words->callback(words->context, flags, token, size, words->base + start, words->base + end);
+}
+
+// Invalid bytes decode as themselves, which is never a CJK code point.
+char32_t next_code_point(const char *text, int size, int &pos) {
+    const auto lead = static_cast<unsigned char>(text[pos]);
+    int length = 1;
+    char32_t value = lead;
+    if (lead >= 0xF0U && lead < 0xF8U) {
+        length = 4;
+        value = lead & 0x07U;
+    }
+    else if (lead >= 0xE0U) {
+        length = lead < 0xF0U ? 3 : 1;
+        value = lead < 0xF0U ? lead & 0x0FU : lead;
+    }
+    else if (lead >= 0xC0U) {
+        length = 2;
+        value = lead & 0x1FU;
+    }
+    if (length == 1 || pos + length > size) {
+        ++pos;
+        return lead;
+    }
+    for (int i = 1; i < length; ++i) {
+        const auto byte = static_cast<unsigned char>(text[pos + i]);
+        if ((byte & 0xC0U) != 0x80U) {
+            ++pos;
+            return lead;
+        }
+        value = (value << 6) | (byte & 0x3FU);
+    }
+    pos += length;
+    return value;
+}
+
+bool is_cjk(char32_t cp) {
+    return (cp >= 0x3040U && cp <= 0x30FFU) ||   // hiragana, katakana
+           (cp >= 0x31F0U && cp <= 0x31FFU) ||   // katakana phonetic extensions
+           (cp >= 0x3400U && cp <= 0x4DBFU) ||   // CJK extension A
+           (cp >= 0x4E00U && cp <= 0x9FFFU) ||   // CJK unified ideographs
+           (cp >= 0xAC00U && cp <= 0xD7AFU) ||   // Hangul syllables
+           (cp >= 0x1100U && cp <= 0x11FFU) ||   // Hangul jamo
+           (cp >= 0x3130U && cp <= 0x318FU) ||   // Hangul compatibility jamo
+           (cp >= 0xF900U && cp <= 0xFAFFU) ||   // CJK compatibility ideographs
+           (cp >= 0xFF66U && cp <= 0xFF9FU) ||   // halfwidth katakana
+           (cp >= 0x20000U && cp <= 0x3134FU);   // CJK extensions B-G
+}
+
+int cjk_create(void *user_data, const char **args, int arg_count, Fts5Tokenizer **out) {
+    auto *api = static_cast<fts5_api *>(user_data);
+    auto *tokenizer = new (std::nothrow) cjk_tokenizer{};
+    if (tokenizer == nullptr) {
+        return SQLITE_NOMEM;
+    }
+    void *word_data = nullptr;
+    int rc = api->xFindTokenizer(api, "unicode61", &word_data, &tokenizer->words);
+    if (rc == SQLITE_OK) {
+        rc = tokenizer->words.xCreate(word_data, args, arg_count, &tokenizer->word_tokenizer);
+    }
+    if (rc != SQLITE_OK) {
+        delete tokenizer;
+        return rc;
+    }
+    *out = reinterpret_cast<Fts5Tokenizer *>(tokenizer);
+    return SQLITE_OK;
+}
+
+void cjk_delete(Fts5Tokenizer *handle) {
+    auto *tokenizer = reinterpret_cast<cjk_tokenizer *>(handle);
+    if (tokenizer->word_tokenizer != nullptr) {
+        tokenizer->words.xDelete(tokenizer->word_tokenizer);
+    }
+    delete tokenizer;
+}
+
+int cjk_tokenize(Fts5Tokenizer *handle, void *context, int flags, const char *text, int size, token_callback callback) {
+    const auto *tokenizer = reinterpret_cast<const cjk_tokenizer *>(handle);
+    const auto tokenize_words = [&](int begin, int end) {
+        if (begin == end) {
+            return SQLITE_OK;
+        }
+        word_context words{context, callback, begin};
+        return tokenizer->words.xTokenize(tokenizer->word_tokenizer, &words, flags, text + begin, end - begin, forward_word);
+    };
+
+    int words_begin = 0;
+    int pos = 0;
+    while (pos < size) {
+        const int run_begin = pos;
+        if (!is_cjk(next_code_point(text, size, pos))) {
+            continue;
+        }
+        int rc = tokenize_words(words_begin, run_begin);
+        if (rc != SQLITE_OK) {
+            return rc;
+        }
+        int previous = run_begin;
+        bool single = true;
+        while (pos < size) {
+            const int next = pos;
+            if (!is_cjk(next_code_point(text, size, pos))) {
+                pos = next;
+                break;
+            }
+            rc = callback(context, 0, text + previous, pos - previous, previous, pos);
+            if (rc != SQLITE_OK) {
+                return rc;
+            }
+            previous = next;
+            single = false;
+        }
+        if (single) {
+            rc = callback(context, 0, text + run_begin, pos - run_begin, run_begin, pos);
+            if (rc != SQLITE_OK) {
+                return rc;
+            }
+        }
+        words_begin = pos;
+    }
+    return tokenize_words(words_begin, size);
+}
+}
+
+void register_cjk_tokenizer(sqlite3 *db) {
+    fts5_api *api = find_fts5_api(db);
+    fts5_tokenizer methods{cjk_create, cjk_delete, cjk_tokenize};
+    if (api->xCreateTokenizer(api, cjk_tokenizer_name, api, &methods, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("failed to register fts5 tokenizer: " + std::string{cjk_tokenizer_name});
+    }
+}
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <sqlite3.h>
+
+namespace retort
+{
+// FTS5 tokenizer for mixed CJK and Latin text. Runs of Han, kana and Hangul
+// become overlapping character bigrams (a lone character stays a unigram);
+// all other text goes through unicode61, created with the same arguments.
+// Queries are split the same way, so a CJK word matches as a phrase of its
+// bigrams.
+constexpr const char *cjk_tokenizer_name = "retort_cjk";
+
+// Registers the tokenizer on a connection; every connection that opens an
+// index created with it must do so first.
+void register_cjk_tokenizer(sqlite3 *db);
+}
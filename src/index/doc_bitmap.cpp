@@ -0,0 +1,256 @@
+#include "doc_bitmap.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define RETORT_BITMAP_X86 1
+#endif
+
+namespace retort
+{
+namespace
+{
+constexpr std::uint32_t max_array_size = 4096U;
+constexpr std::size_t chunk_words = 65536U / 64U;
+
+// Bits set in both a and b. Without -mpopcnt the compiler turns
+// std::popcount into a libgcc call per word, so x86 gets a POPCNT build
+// picked by CPUID, like the posting kernels.
+std::size_t and_popcount_scalar(const std::uint64_t *a, const std::uint64_t *b, std::size_t size) {
+    std::size_t total = 0U;
+    for (std::size_t i = 0U; i < size; ++i) {
+        total += static_cast<std::size_t>(std::popcount(a[i] & b[i]));
+    }
+    return total;
+}
+
+#if defined(RETORT_BITMAP_X86)
+__attribute__((target("popcnt"))) std::size_t and_popcount_popcnt(const std::uint64_t *a, const std::uint64_t *b, std::size_t size) {
+    std::size_t total = 0U;
+    for (std::size_t i = 0U; i < size; ++i) {
+        total += static_cast<std::size_t>(__builtin_popcountll(a[i] & b[i]));
+    }
+    return total;
+}
+
+bool detect_popcnt() {
+    unsigned int eax = 0U;
+    unsigned int ebx = 0U;
+    unsigned int ecx = 0U;
+    unsigned int edx = 0U;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) != 0 && (ecx & (1U << 23)) != 0U;
+}
+
+const bool has_popcnt = detect_popcnt();
+#endif
+
+std::size_t and_popcount(const std::uint64_t *a, const std::uint64_t *b, std::size_t size) {
+#if defined(RETORT_BITMAP_X86)
+    if (has_popcnt) {
+        return and_popcount_popcnt(a, b, size);
+    }
+#endif
+    return and_popcount_scalar(a, b, size);
+}
+
+template <typename T>
+void put(std::vector<std::uint8_t> &out, T value) {
+    const auto pos = out.size();
+    out.resize(pos + sizeof(T));
+    std::memcpy(out.data() + pos, &value, sizeof(T));
+}
+
+template <typename T>
+T take(std::span<const std::uint8_t> bytes, std::size_t &pos) {
+    if (bytes.size() - pos < sizeof(T)) {
+        throw std::runtime_error("truncated doc bitmap");
+    }
+    T value;
+    std::memcpy(&value, bytes.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return value;
+}
+}
+
+bool doc_bitmap::container::is_bitmap() const noexcept
+{
+    return cardinality > max_array_size;
+}
+
+doc_bitmap doc_bitmap::from_sorted(std::span<const std::uint32_t> ids)
+{
+    doc_bitmap bitmap;
+    std::size_t begin = 0U;
+    while (begin < ids.size()) {
+        const auto key = static_cast<std::uint16_t>(ids[begin] >> 16U);
+        auto end = begin;
+        while (end < ids.size() && (ids[end] >> 16U) == key) {
+            ++end;
+        }
+        container chunk{key, static_cast<std::uint32_t>(end - begin), 0U};
+        if (chunk.is_bitmap()) {
+            chunk.offset = static_cast<std::uint32_t>(bitmap.bitmaps_.size());
+            bitmap.bitmaps_.resize(bitmap.bitmaps_.size() + chunk_words, 0U);
+            auto *words = bitmap.bitmaps_.data() + chunk.offset;
+            for (auto i = begin; i < end; ++i) {
+                const auto low = ids[i] & 0xFFFFU;
+                words[low >> 6U] |= std::uint64_t{1} << (low & 63U);
+            }
+        }
+        else {
+            chunk.offset = static_cast<std::uint32_t>(bitmap.arrays_.size());
+            for (auto i = begin; i < end; ++i) {
+                bitmap.arrays_.push_back(static_cast<std::uint16_t>(ids[i] & 0xFFFFU));
+            }
+        }
+        bitmap.containers_.push_back(chunk);
+        begin = end;
+    }
+    return bitmap;
+}
+
+// Layout: u32 chunk count, then per chunk u16 key and u32 cardinality, then
+// every chunk's payload in the same order (u16 low halves or 1024 u64
+// words), all in host byte order like segment files.
+std::vector<std::uint8_t> doc_bitmap::serialize() const
+{
+    std::vector<std::uint8_t> out;
+    put(out, static_cast<std::uint32_t>(containers_.size()));
+    for (const auto &chunk : containers_) {
+        put(out, chunk.key);
+        put(out, chunk.cardinality);
+    }
+    for (const auto &chunk : containers_) {
+        if (chunk.is_bitmap()) {
+            for (std::size_t i = 0U; i < chunk_words; ++i) {
+                put(out, bitmaps_[chunk.offset + i]);
+            }
+        }
+        else {
+            for (std::uint32_t i = 0U; i < chunk.cardinality; ++i) {
+                put(out, arrays_[chunk.offset + i]);
+            }
+        }
+    }
+    return out;
+}
+
+doc_bitmap doc_bitmap::deserialize(std::span<const std::uint8_t> bytes)
+{
+    doc_bitmap bitmap;
+    std::size_t pos = 0U;
+    const auto count = take<std::uint32_t>(bytes, pos);
+    if (count > 65536U) {
+        throw std::runtime_error("malformed doc bitmap");
+    }
+    bitmap.containers_.resize(count);
+    for (auto &chunk : bitmap.containers_) {
+        chunk.key = take<std::uint16_t>(bytes, pos);
+        chunk.cardinality = take<std::uint32_t>(bytes, pos);
+        if (chunk.cardinality == 0U || chunk.cardinality > 65536U) {
+            throw std::runtime_error("malformed doc bitmap");
+        }
+    }
+    for (auto &chunk : bitmap.containers_) {
+        if (chunk.is_bitmap()) {
+            chunk.offset = static_cast<std::uint32_t>(bitmap.bitmaps_.size());
+            for (std::size_t i = 0U; i < chunk_words; ++i) {
+                bitmap.bitmaps_.push_back(take<std::uint64_t>(bytes, pos));
+            }
+        }
+        else {
+            chunk.offset = static_cast<std::uint32_t>(bitmap.arrays_.size());
+            for (std::uint32_t i = 0U; i < chunk.cardinality; ++i) {
+                bitmap.arrays_.push_back(take<std::uint16_t>(bytes, pos));
+            }
+        }
+    }
+    return bitmap;
+}
+
+std::size_t doc_bitmap::cardinality() const noexcept
+{
+    std::size_t total = 0U;
+    for (const auto &chunk : containers_) {
+        total += chunk.cardinality;
+    }
+    return total;
+}
+
+std::size_t doc_bitmap::dense_words() const noexcept
+{
+    return containers_.empty() ? 0U : (static_cast<std::size_t>(containers_.back().key) + 1U) * chunk_words;
+}
+
+void doc_bitmap::fill_dense(std::vector<std::uint64_t> &dense) const
+{
+    for (const auto &chunk : containers_) {
+        auto *words = dense.data() + static_cast<std::size_t>(chunk.key) * chunk_words;
+        if (chunk.is_bitmap()) {
+            for (std::size_t i = 0U; i < chunk_words; ++i) {
+                words[i] |= bitmaps_[chunk.offset + i];
+            }
+        }
+        else {
+            for (std::uint32_t i = 0U; i < chunk.cardinality; ++i) {
+                const auto low = arrays_[chunk.offset + i];
+                words[low >> 6U] |= std::uint64_t{1} << (low & 63U);
+            }
+        }
+    }
+}
+
+void doc_bitmap::intersect_dense(std::vector<std::uint64_t> &dense) const
+{
+    const std::size_t chunks = (dense.size() + chunk_words - 1U) / chunk_words;
+    auto next = containers_.begin();
+    for (std::size_t key = 0U; key < chunks; ++key) {
+        auto *words = dense.data() + key * chunk_words;
+        const std::size_t size = std::min(chunk_words, dense.size() - key * chunk_words);
+        if (next == containers_.end() || next->key != key) {
+            std::fill(words, words + size, 0U);
+            continue;
+        }
+        const auto &chunk = *next++;
+        if (chunk.is_bitmap()) {
+            for (std::size_t i = 0U; i < size; ++i) {
+                words[i] &= bitmaps_[chunk.offset + i];
+            }
+            continue;
+        }
+        std::uint64_t kept[chunk_words] = {};
+        for (std::uint32_t i = 0U; i < chunk.cardinality; ++i) {
+            const auto low = arrays_[chunk.offset + i];
+            kept[low >> 6U] |= std::uint64_t{1} << (low & 63U);
+        }
+        for (std::size_t i = 0U; i < size; ++i) {
+            words[i] &= kept[i];
+        }
+    }
+}
+
+std::size_t doc_bitmap::count_and(std::span<const std::uint64_t> dense) const
+{
+    std::size_t total = 0U;
+    for (const auto &chunk : containers_) {
+        const std::size_t first = static_cast<std::size_t>(chunk.key) * chunk_words;
+        if (first >= dense.size()) {
+            break;
+        }
+        const auto words = dense.subspan(first, std::min(chunk_words, dense.size() - first));
+        if (chunk.is_bitmap()) {
+            total += and_popcount(words.data(), bitmaps_.data() + chunk.offset, words.size());
+        }
+        else {
+            for (std::uint32_t i = 0U; i < chunk.cardinality; ++i) {
+                total += dense_contains(words, arrays_[chunk.offset + i]) ? 1U : 0U;
+            }
+        }
+    }
+    return total;
+}
+}
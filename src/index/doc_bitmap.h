@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace retort
+{
+// A compressed set of doc rowids in the style of Roaring bitmaps: ids are
+// split by their high 16 bits into chunks, and a chunk holding at most 4096
+// ids stores their low halves as a sorted array, a fuller one as a 65536-bit
+// bitmap. Dense bitsets (bit i set for id i, as a vector of 64-bit words)
+// are the form sets are combined in at query time.
+class doc_bitmap
+{
+public:
+    doc_bitmap() = default;
+
+    // From sorted, duplicate-free ids.
+    static doc_bitmap from_sorted(std::span<const std::uint32_t> ids);
+    // Parses the serialize() layout; throws std::runtime_error when malformed.
+    static doc_bitmap deserialize(std::span<const std::uint8_t> bytes);
+    std::vector<std::uint8_t> serialize() const;
+
+    std::size_t cardinality() const noexcept;
+    // Dense words needed to hold the largest id.
+    std::size_t dense_words() const noexcept;
+
+    // Sets every id's bit in dense, which must have dense_words() words.
+    void fill_dense(std::vector<std::uint64_t> &dense) const;
+    // Clears every bit of dense that is not in this set.
+    void intersect_dense(std::vector<std::uint64_t> &dense) const;
+    // How many ids of this set are also in dense.
+    std::size_t count_and(std::span<const std::uint64_t> dense) const;
+
+private:
+    struct container
+    {
+        std::uint16_t key = 0U;
+        std::uint32_t cardinality = 0U;
+        // Into arrays_ for array chunks, bitmaps_ for bitmap chunks.
+        std::uint32_t offset = 0U;
+
+        bool is_bitmap() const noexcept;
+    };
+
+    std::vector<container> containers_;
+    std::vector<std::uint16_t> arrays_;
+    std::vector<std::uint64_t> bitmaps_;
+};
+
+inline void dense_insert(std::vector<std::uint64_t> &dense, std::uint64_t id) {
+    const auto word = id >> 6U;
+    if (word >= dense.size()) {
+        dense.resize(word + 1U, 0U);
+    }
+    dense[word] |= std::uint64_t{1} << (id & 63U);
+}
+
+inline bool dense_contains(std::span<const std::uint64_t> dense, std::uint64_t id) {
+    const auto word = id >> 6U;
+    return word < dense.size() && ((dense[word] >> (id & 63U)) & 1U) != 0U;
+}
+}
@@ -7,6 +7,8 @@ namespace retort
 {
 struct document_row
 {
+    // Dense 1-based id shared by docs.id and docs_fts.rowid.
+    std::int64_t id = 0;
     std::string doc_id;
     std::string url;
     std::string format;
@@ -0,0 +1,57 @@
+#include "fts5_tokenizer.h"
+
+#include <stdexcept>
+
+namespace retort
+{
+fts5_api *find_fts5_api(sqlite3 *db) {
+    fts5_api *api = nullptr;
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, "SELECT fts5(?1)", -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("fts5 is not available");
+    }
+    sqlite3_bind_pointer(stmt, 1, &api, "fts5_api_ptr", nullptr);
+    sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (api == nullptr || api->iVersion < 2) {
+        throw std::runtime_error("fts5 is not available");
+    }
+    return api;
+}
+
+fts5_tokenizer_handle::fts5_tokenizer_handle(sqlite3 *db, const std::string &name)
+{
+    fts5_api *api = find_fts5_api(db);
+    void *user_data = nullptr;
+    if (api->xFindTokenizer(api, name.c_str(), &user_data, &methods_) != SQLITE_OK) {
+        throw std::runtime_error("unknown fts5 tokenizer: " + name);
+    }
+    if (methods_.xCreate(user_data, nullptr, 0, &tokenizer_) != SQLITE_OK) {
+        throw std::runtime_error("failed to create fts5 tokenizer: " + name);
+    }
+}
+
+fts5_tokenizer_handle::~fts5_tokenizer_handle()
+{
+    if (tokenizer_ != nullptr) {
+        methods_.xDelete(tokenizer_);
+        tokenizer_ = nullptr;
+    }
+}
+
+std::vector<fts5_token> fts5_tokenizer_handle::tokenize(std::string_view text, int flags) const
+{
+    std::vector<fts5_token> tokens;
+    for_each_token(text, flags, [&tokens](std::string_view token, int start, int end) {
+        tokens.push_back(fts5_token{std::string{token}, start, end});
+    });
+    return tokens;
+}
+
+void fts5_tokenizer_handle::run(std::string_view text, int flags, void *context, token_callback callback) const
+{
+    if (methods_.xTokenize(tokenizer_, context, flags, text.data(), static_cast<int>(text.size()), callback) != SQLITE_OK) {
+        throw std::runtime_error("fts5 tokenizer failed");
+    }
+}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "sqlite_database.h"
+
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace retort
+{
+struct fts5_token
+{
+    std::string text;
+    int start = 0;
+    int end = 0;
+};
+
+// An instance of a tokenizer registered with FTS5 on a connection, so code
+// outside SQL can split text exactly the way docs_fts does. The connection
+// must outlive the handle.
+class fts5_tokenizer_handle
+{
+public:
+    fts5_tokenizer_handle(sqlite3 *db, const std::string &name);
+    ~fts5_tokenizer_handle();
+
+    fts5_tokenizer_handle(const fts5_tokenizer_handle &) = delete;
+    fts5_tokenizer_handle &operator=(const fts5_tokenizer_handle &) = delete;
+
+    // flags is FTS5_TOKENIZE_DOCUMENT or FTS5_TOKENIZE_QUERY (optionally
+    // with FTS5_TOKENIZE_PREFIX). Colocated tokens are skipped.
+    std::vector<fts5_token> tokenize(std::string_view text, int flags) const;
+
+    // callback(std::string_view token, int start, int end) per token.
+    template <typename Callback>
+    void for_each_token(std::string_view text, int flags, Callback &&callback) const
+    {
+        using callback_type = std::remove_reference_t<Callback>;
+        const auto trampoline = [](void *context, int token_flags, const char *token, int size, int start, int end) -> int {
+            if ((token_flags & FTS5_TOKEN_COLOCATED) != 0) {
+                return SQLITE_OK;
+            }
+            try {
+                (*static_cast<callback_type *>(context))(std::string_view{token, static_cast<std::size_t>(size)}, start, end);
+            }
+            catch (...) {
+                return SQLITE_ERROR;
+            }
+            return SQLITE_OK;
+        };
+        run(text, flags, &callback, trampoline);
+    }
+
+private:
+    using token_callback = int (*)(void *, int, const char *, int, int, int);
+
+    void run(std::string_view text, int flags, void *context, token_callback callback) const;
+
+    fts5_tokenizer methods_{};
+    Fts5Tokenizer *tokenizer_ = nullptr;
+};
+
+fts5_api *find_fts5_api(sqlite3 *db);
+}
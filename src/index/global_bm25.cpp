@@ -0,0 +1,128 @@
+#include "global_bm25.h"
+
+#include "index/fts5_tokenizer.h"
+
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace retort
+{
+namespace
+{
+constexpr double bm25_k1 = 1.2;
+constexpr double bm25_b = 0.75;
+
+int count_row(const Fts5ExtensionApi *, Fts5Context *, void *user_data) {
+    ++*static_cast<std::int64_t *>(user_data);
+    return SQLITE_OK;
+}
+
+void bm25_stats(const Fts5ExtensionApi *api, Fts5Context *fts, sqlite3_context *context, int, sqlite3_value **) {
+    sqlite3_int64 rows = 0;
+    sqlite3_int64 tokens = 0;
+    int rc = api->xRowCount(fts, &rows);
+    if (rc == SQLITE_OK) {
+        rc = api->xColumnTotalSize(fts, -1, &tokens);
+    }
+    std::string result = std::to_string(rows) + ' ' + std::to_string(tokens);
+    for (int phrase = 0; rc == SQLITE_OK && phrase < api->xPhraseCount(fts); ++phrase) {
+        std::int64_t docs = 0;
+        rc = api->xQueryPhrase(fts, phrase, &docs, count_row);
+        result += ' ' + std::to_string(docs);
+    }
+    if (rc != SQLITE_OK) {
+        sqlite3_result_error_code(context, rc);
+        return;
+    }
+    sqlite3_result_text(context, result.c_str(), static_cast<int>(result.size()), SQLITE_TRANSIENT);
+}
+
+// Per statement, like bm25()'s own: the idf of every phrase, the average row
+// length and the column weights.
+struct bm25_inputs
+{
+    std::vector<double> idf;
+    std::vector<double> weights;
+    double average_length = 1.0;
+};
+
+void destroy_inputs(void *inputs) {
+    delete static_cast<bm25_inputs *>(inputs);
+}
+
+// Mirrors fts5's bm25(): per phrase, idf * f(k1+1) / (f + k1(1 - b + b * D /
+// avgdl)), f counting the phrase's instances weighted by their column and D
+// being the row's length over all columns.
+void global_bm25(const Fts5ExtensionApi *api, Fts5Context *fts, sqlite3_context *context, int argc, sqlite3_value **argv) {
+    const int phrases = api->xPhraseCount(fts);
+    const int columns = api->xColumnCount(fts);
+    auto *inputs = static_cast<bm25_inputs *>(api->xGetAuxdata(fts, 0));
+    if (inputs == nullptr) {
+        if (argc < 3 || sqlite3_value_int(argv[2]) != phrases || argc < 3 + phrases) {
+            sqlite3_result_error(context, "retort_bm25: statistics do not match the query", -1);
+            return;
+        }
+        auto fresh = std::make_unique<bm25_inputs>();
+        const auto rows = static_cast<double>(sqlite3_value_int64(argv[0]));
+        const auto tokens = static_cast<double>(sqlite3_value_int64(argv[1]));
+        fresh->average_length = rows > 0.0 && tokens > 0.0 ? tokens / rows : 1.0;
+        for (int phrase = 0; phrase < phrases; ++phrase) {
+            const auto docs = static_cast<double>(sqlite3_value_int64(argv[3 + phrase]));
+            const double value = std::log((rows - docs + 0.5) / (docs + 0.5));
+            fresh->idf.push_back(value <= 0.0 ? 1e-6 : value);
+        }
+        for (int column = 0; column < columns; ++column) {
+            const int arg = 3 + phrases + column;
+            fresh->weights.push_back(arg < argc ? sqlite3_value_double(argv[arg]) : 1.0);
+        }
+        inputs = fresh.get();
+        const int rc = api->xSetAuxdata(fts, fresh.release(), destroy_inputs);
+        if (rc != SQLITE_OK) {
+            sqlite3_result_error_code(context, rc);
+            return;
+        }
+    }
+
+    int length = 0;
+    int instances = 0;
+    int rc = api->xColumnSize(fts, -1, &length);
+    if (rc == SQLITE_OK) {
+        rc = api->xInstCount(fts, &instances);
+    }
+    std::vector<double> freqs(static_cast<std::size_t>(phrases), 0.0);
+    for (int i = 0; rc == SQLITE_OK && i < instances; ++i) {
+        int phrase = 0;
+        int column = 0;
+        int offset = 0;
+        rc = api->xInst(fts, i, &phrase, &column, &offset);
+        if (rc == SQLITE_OK) {
+            freqs[static_cast<std::size_t>(phrase)] += inputs->weights[static_cast<std::size_t>(column)];
+        }
+    }
+    if (rc != SQLITE_OK) {
+        sqlite3_result_error_code(context, rc);
+        return;
+    }
+
+    const double norm = bm25_k1 * (1.0 - bm25_b + bm25_b * length / inputs->average_length);
+    double score = 0.0;
+    for (int phrase = 0; phrase < phrases; ++phrase) {
+        const double f = freqs[static_cast<std::size_t>(phrase)];
+        score += inputs->idf[static_cast<std::size_t>(phrase)] * (f * (bm25_k1 + 1.0)) / (f + norm);
+    }
+    sqlite3_result_double(context, -1.0 * score);
+}
+}
+
+void register_global_bm25(sqlite3 *db) {
+    fts5_api *api = find_fts5_api(db);
+    if (api->xCreateFunction(api, global_bm25_name, nullptr, global_bm25, nullptr) != SQLITE_OK ||
+        api->xCreateFunction(api, bm25_stats_name, nullptr, bm25_stats, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("failed to register fts5 ranking functions");
+    }
+}
+}
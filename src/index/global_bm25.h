@@ -0,0 +1,23 @@
+#pragma once
+
+#include <sqlite3.h>
+
+namespace retort
+{
+// FTS5 auxiliary functions for ranking across shards, where each file's own
+// bm25() statistics would make scores incomparable.
+//
+// retort_bm25_stats(tbl) returns "rows tokens df..." as text: the table's row
+// count, its total token count and, for every phrase of the current match in
+// query order, the number of rows containing it.
+//
+// retort_bm25(tbl, rows, tokens, n, df_1 ... df_n [, weights...]) is bm25()
+// computed from those values instead of the table's own, so shards given the
+// summed statistics score as one index would. Arguments must be literals to
+// be used as a rank function (rank MATCH 'retort_bm25(...)').
+constexpr const char *global_bm25_name = "retort_bm25";
+constexpr const char *bm25_stats_name = "retort_bm25_stats";
+
+// Registers both functions on a connection.
+void register_global_bm25(sqlite3 *db);
+}
@@ -1,8 +1,35 @@
 #include "schema_migration.h"
 
+#include <sstream>
+#include <string>
+
 namespace retort
 {
-void ensure_schema(sqlite_database &db) {
+std::string format_prefix_index(const std::vector<std::size_t> &lengths) {
+    std::string value;
+    for (const auto length : lengths) {
+        if (!value.empty()) {
+            value += ' ';
+        }
+        value += std::to_string(length);
+    }
+    return value;
+}
+
+std::vector<std::size_t> parse_prefix_index_meta(const std::string &value) {
+    std::istringstream stream{value};
+    std::vector<std::size_t> lengths;
+    std::size_t length = 0U;
+    while (stream >> length) {
+        lengths.push_back(length);
+    }
+    return lengths;
+}
+
+void ensure_schema(sqlite_database &db,
+                   const std::vector<std::size_t> &prefix_lengths,
+                   std::string_view tokenizer) {
+    db.exec("PRAGMA page_size=8192;");
     db.exec("PRAGMA journal_mode=OFF;");
     db.exec("PRAGMA synchronous=OFF;");
     db.exec("PRAGMA temp_store=MEMORY;");
@@ -11,14 +38,16 @@ void ensure_schema(sqlite_database &db) {
 
     db.exec(
         "CREATE TABLE IF NOT EXISTS docs ("
-        " doc_id TEXT PRIMARY KEY,"
+        " id INTEGER PRIMARY KEY,"
+        " doc_id TEXT NOT NULL UNIQUE,"
         " url TEXT NOT NULL,"
         " format TEXT NOT NULL,"
         " title TEXT NOT NULL,"
         " tags TEXT,"
         " lang TEXT,"
         " updated_at INTEGER NOT NULL,"
-        " sha1 TEXT NOT NULL"
+        " sha1 TEXT NOT NULL,"
+        " body BLOB NOT NULL"
         ");");
 
     db.exec(
@@ -28,12 +57,63 @@ void ensure_schema(sqlite_database &db) {
         ");");
 
     db.exec(
-        "CREATE VIRTUAL TABLE IF NOT EXISTS docs_fts"
-        " USING fts5(doc_id UNINDEXED, title, body_tokens, tokenize='unicode61');");
+        "CREATE TABLE IF NOT EXISTS hot_prefixes ("
+        " prefix TEXT NOT NULL,"
+        " rank INTEGER NOT NULL,"
+        " hit TEXT NOT NULL,"
+        " PRIMARY KEY(prefix, rank)"
+        ") WITHOUT ROWID;");
+
+    db.exec(
+        "CREATE TABLE IF NOT EXISTS term_dictionary ("
+        " term TEXT PRIMARY KEY,"
+        " doc_freq INTEGER NOT NULL"
+        ") WITHOUT ROWID;");
+
+    db.exec(
+        "CREATE TABLE IF NOT EXISTS spelling_deletes ("
+        " variant TEXT PRIMARY KEY,"
+        " term_ids BLOB NOT NULL"
+        ") WITHOUT ROWID;");
+
+    db.exec(
+        "CREATE TABLE IF NOT EXISTS completions ("
+        " term TEXT PRIMARY KEY,"
+        " weight INTEGER NOT NULL"
+        ") WITHOUT ROWID;");
+
+    db.exec(
+        "CREATE TABLE IF NOT EXISTS facet_bitmaps ("
+        " kind TEXT NOT NULL,"
+        " value TEXT NOT NULL,"
+        " doc_count INTEGER NOT NULL,"
+        " bitmap BLOB NOT NULL,"
+        " PRIMARY KEY(kind, value)"
+        ") WITHOUT ROWID;");
+
+    db.exec(
+        "CREATE VIEW IF NOT EXISTS docs_fts_content AS"
+        " SELECT id, title, retort_inflate(body) AS body_tokens"
+        " FROM docs;");
+
+    std::string fts_options = std::string{"content='docs_fts_content', content_rowid='id', tokenize='"};
+    fts_options.append(tokenizer).append("'");
+    if (!prefix_lengths.empty()) {
+        fts_options += ", prefix='" + format_prefix_index(prefix_lengths) + "'";
+    }
+    db.exec("CREATE VIRTUAL TABLE IF NOT EXISTS docs_fts USING fts5(title, body_tokens, " + fts_options + ");");
+    // Titles alone, for title-first typeahead; a small fraction of docs_fts.
+    db.exec("CREATE VIRTUAL TABLE IF NOT EXISTS docs_fts_title USING fts5(title, " + fts_options + ");");
 
     db.exec(
         "CREATE VIEW IF NOT EXISTS v_search AS"
-        " SELECT d.url, d.title, d.format, d.tags, d.lang, d.updated_at, d.doc_id"
+        " SELECT d.url, d.title, d.format, d.tags, d.lang, d.updated_at, d.doc_id, d.id"
         " FROM docs d;");
 }
+
+void ensure_trigram_schema(sqlite_database &db) {
+    db.exec(
+        "CREATE VIRTUAL TABLE IF NOT EXISTS docs_fts_tri USING fts5(title, body_tokens,"
+        " content='docs_fts_content', content_rowid='id', tokenize='trigram');");
+}
 }
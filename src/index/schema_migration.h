@@ -2,7 +2,37 @@
 
 #include "sqlite_database.h"
 
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
 namespace retort
 {
-void ensure_schema(sqlite_database &db);
+// v1: docs_fts stores doc_id, title and body_tokens itself and joins docs on
+// the TEXT doc_id. v2: docs_fts is external content over docs, keyed by the
+// integer docs.id, with the body kept zlib-compressed in docs.body.
+constexpr int current_schema_version = 2;
+
+// docs_fts is created with this tokenizer unless the writer picks another;
+// the name actually used is kept in the "tokenizer" meta row. Code that reads
+// the index outside SQL must split text with the same one.
+constexpr const char *fts_tokenizer_name = "unicode61";
+
+// Space-separated, as FTS5's prefix= option and the prefix_index meta row
+// spell it.
+std::string format_prefix_index(const std::vector<std::size_t> &lengths);
+std::vector<std::size_t> parse_prefix_index_meta(const std::string &value);
+
+// prefix_lengths and tokenizer only apply when docs_fts is created; FTS5
+// then keeps an extra index for prefix queries of each of those lengths in
+// characters.
+void ensure_schema(sqlite_database &db,
+                   const std::vector<std::size_t> &prefix_lengths = {},
+                   std::string_view tokenizer = fts_tokenizer_name);
+
+// docs_fts_tri indexes the same content with FTS5's trigram tokenizer, so a
+// quoted string matches any case-insensitive substring of at least three
+// characters.
+void ensure_trigram_schema(sqlite_database &db);
 }
@@ -0,0 +1,185 @@
+#include "segment_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace retort
+{
+namespace
+{
+constexpr std::size_t section_alignment = 8U;
+
+std::size_t align_up(std::size_t value) {
+    return (value + section_alignment - 1U) / section_alignment * section_alignment;
+}
+
+std::uint32_t crc_of(std::span<const std::uint8_t> bytes, std::uint32_t crc = 0U) {
+    return static_cast<std::uint32_t>(crc32_z(crc, bytes.data(), bytes.size()));
+}
+
+std::uint32_t header_crc_of(const segment_header &header, std::span<const std::uint8_t> directory) {
+    segment_header copy = header;
+    copy.header_crc = 0U;
+    const auto crc = crc_of({reinterpret_cast<const std::uint8_t *>(&copy), sizeof(copy)});
+    return crc_of(directory, crc);
+}
+}
+
+std::vector<std::uint8_t> pack_segment(std::span<const segment_part> parts) {
+    const std::size_t directory_size = parts.size() * sizeof(segment_section_entry);
+    std::vector<segment_section_entry> entries;
+    std::size_t offset = align_up(sizeof(segment_header) + directory_size);
+    for (const auto &part : parts) {
+        entries.push_back(segment_section_entry{static_cast<std::uint32_t>(part.id), crc_of(part.bytes), offset, part.bytes.size()});
+        offset = align_up(offset + part.bytes.size());
+    }
+
+    std::vector<std::uint8_t> image(offset, 0U);
+    segment_header header{};
+    std::memcpy(header.magic, segment_magic.data(), sizeof(header.magic));
+    header.version = segment_version;
+    header.byte_order = segment_byte_order;
+    header.file_size = offset;
+    header.section_count = static_cast<std::uint32_t>(parts.size());
+    if (directory_size != 0U) {
+        std::memcpy(image.data() + sizeof(header), entries.data(), directory_size);
+    }
+    header.header_crc = header_crc_of(header, {image.data() + sizeof(header), directory_size});
+    std::memcpy(image.data(), &header, sizeof(header));
+    for (std::size_t i = 0U; i < parts.size(); ++i) {
+        std::copy(parts[i].bytes.begin(), parts[i].bytes.end(), image.begin() + static_cast<std::ptrdiff_t>(entries[i].offset));
+    }
+    return image;
+}
+
+void write_segment_file(const std::filesystem::path &path, std::span<const std::uint8_t> image) {
+    {
+        std::ofstream stream{path, std::ios::binary | std::ios::trunc};
+        stream.write(reinterpret_cast<const char *>(image.data()), static_cast<std::streamsize>(image.size()));
+        stream.flush();
+        if (!stream) {
+            throw std::runtime_error("failed to write segment: " + path.string());
+        }
+    }
+    const mapped_file written{path};
+    segment_view{written.bytes()}.verify_checksums();
+}
+
+bool is_segment_file(const std::filesystem::path &path) {
+    std::ifstream stream{path, std::ios::binary};
+    std::string magic(segment_magic.size(), '\0');
+    stream.read(magic.data(), static_cast<std::streamsize>(magic.size()));
+    return static_cast<std::size_t>(stream.gcount()) == magic.size() && magic == segment_magic;
+}
+
+mapped_file::mapped_file(const std::filesystem::path &path)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("failed to open segment: " + path.string());
+    }
+    struct stat info{};
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        throw std::runtime_error("failed to stat segment: " + path.string());
+    }
+    size_ = static_cast<std::size_t>(info.st_size);
+    if (size_ != 0U) {
+        data_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (data_ == MAP_FAILED) {
+        data_ = nullptr;
+        throw std::runtime_error("failed to map segment: " + path.string());
+    }
+}
+
+mapped_file::~mapped_file()
+{
+    if (data_ != nullptr) {
+        munmap(data_, size_);
+    }
+}
+
+std::span<const std::uint8_t> mapped_file::bytes() const noexcept
+{
+    return {static_cast<const std::uint8_t *>(data_), size_};
+}
+
+segment_view::segment_view(std::span<const std::uint8_t> image)
+    : image_{image}
+{
+    segment_header header{};
+    if (image.size() < sizeof(header)) {
+        throw std::runtime_error("segment is truncated");
+    }
+    std::memcpy(&header, image.data(), sizeof(header));
+    if (std::string_view{header.magic, sizeof(header.magic)} != segment_magic) {
+        throw std::runtime_error("not an index segment");
+    }
+    if (header.byte_order != segment_byte_order) {
+        throw std::runtime_error("segment byte order does not match this host");
+    }
+    if (header.version != segment_version) {
+        throw std::runtime_error("unsupported segment version: " + std::to_string(header.version));
+    }
+    const std::size_t directory_size = std::size_t{header.section_count} * sizeof(segment_section_entry);
+    if (header.file_size != image.size() || sizeof(header) + directory_size > image.size()) {
+        throw std::runtime_error("segment is truncated");
+    }
+    const auto directory = image.subspan(sizeof(header), directory_size);
+    if (header_crc_of(header, directory) != header.header_crc) {
+        throw std::runtime_error("segment header checksum mismatch");
+    }
+    sections_ = {reinterpret_cast<const segment_section_entry *>(directory.data()), header.section_count};
+    for (const auto &entry : sections_) {
+        if (entry.offset % section_alignment != 0U || entry.offset > image.size() || entry.size > image.size() - entry.offset) {
+            throw std::runtime_error("corrupt segment directory");
+        }
+    }
+}
+
+std::span<const std::uint8_t> segment_view::section(segment_section id) const
+{
+    for (const auto &entry : sections_) {
+        if (entry.id == static_cast<std::uint32_t>(id)) {
+            return image_.subspan(entry.offset, entry.size);
+        }
+    }
+    return {};
+}
+
+std::optional<std::string_view> segment_view::meta(std::string_view key) const
+{
+    const auto bytes = section(segment_section::meta);
+    std::string_view rest{reinterpret_cast<const char *>(bytes.data()), bytes.size()};
+    while (!rest.empty()) {
+        const auto key_end = rest.find('\0');
+        const auto value_end = key_end == std::string_view::npos ? key_end : rest.find('\0', key_end + 1U);
+        if (value_end == std::string_view::npos) {
+            throw std::runtime_error("corrupt segment meta");
+        }
+        if (rest.substr(0U, key_end) == key) {
+            return rest.substr(key_end + 1U, value_end - key_end - 1U);
+        }
+        rest.remove_prefix(value_end + 1U);
+    }
+    return std::nullopt;
+}
+
+void segment_view::verify_checksums() const
+{
+    for (const auto &entry : sections_) {
+        if (crc_of(image_.subspan(entry.offset, entry.size)) != entry.crc) {
+            throw std::runtime_error("segment section checksum mismatch: " + std::to_string(entry.id));
+        }
+    }
+}
+}
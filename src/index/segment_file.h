@@ -0,0 +1,84 @@
+#pragma once
+
+#include "index/segment_format.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace retort
+{
+struct segment_part
+{
+    segment_section id;
+    std::span<const std::uint8_t> bytes;
+};
+
+// Lays the parts out behind a header and section directory and fills in
+// every checksum.
+std::vector<std::uint8_t> pack_segment(std::span<const segment_part> parts);
+
+// Writes a packed image to path, then maps it back and verifies every
+// section checksum.
+void write_segment_file(const std::filesystem::path &path, std::span<const std::uint8_t> image);
+
+// True when the file starts with the segment magic.
+bool is_segment_file(const std::filesystem::path &path);
+
+// A read-only mapping of a whole file. Pages come straight from the
+// page cache, so processes serving the same segment share one copy.
+class mapped_file
+{
+public:
+    mapped_file() = default;
+    explicit mapped_file(const std::filesystem::path &path);
+    ~mapped_file();
+
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    mapped_file(mapped_file &&) = delete;
+    mapped_file &operator=(mapped_file &&) = delete;
+
+    std::span<const std::uint8_t> bytes() const noexcept;
+
+private:
+    void *data_ = nullptr;
+    std::size_t size_ = 0U;
+};
+
+// Checks the header and section directory of an image and hands out its
+// sections. Construction is O(1) in the size of the image; section
+// checksums are only read by verify_checksums().
+class segment_view
+{
+public:
+    explicit segment_view(std::span<const std::uint8_t> image);
+
+    std::span<const std::uint8_t> section(segment_section id) const;
+
+    template <typename T>
+    std::span<const T> records(segment_section id) const
+    {
+        const auto bytes = section(id);
+        if (bytes.size() % sizeof(T) != 0U) {
+            throw std::runtime_error("corrupt segment section size");
+        }
+        return {reinterpret_cast<const T *>(bytes.data()), bytes.size() / sizeof(T)};
+    }
+
+    std::optional<std::string_view> meta(std::string_view key) const;
+
+    void verify_checksums() const;
+
+private:
+    std::span<const std::uint8_t> image_;
+    std::span<const segment_section_entry> sections_;
+};
+}
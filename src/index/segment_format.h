@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace retort
+{
+// An immutable index segment (retort write --format segment) is one
+// little-endian file:
+//
+//   segment_header | segment_section_entry[section_count] | sections
+//
+// Each section starts on an 8-byte boundary and holds flat records, so a
+// reader maps the file and points into it without parsing. header_crc is the
+// CRC-32 of the header (with header_crc zeroed) and the section directory;
+// every directory entry carries the CRC-32 of its section.
+constexpr std::string_view segment_magic{"RTSEGMNT"};
+constexpr std::uint32_t segment_version = 1U;
+constexpr std::uint32_t segment_byte_order = 0x01020304U;
+
+enum class segment_section : std::uint32_t
+{
+    meta = 1,     // "key\0value\0" pairs: the meta table plus "tokenizer"
+    stats,        // one segment_stats
+    docs,         // segment_doc per document, in rowid order
+    doc_strings,  // url, title, format, tags, lang and deflated body of each doc
+    lengths,      // uint32 token count per document
+    terms,        // segment_term per term, sorted by text
+    term_text,
+    blocks,       // segment_block per 128 postings
+    postings,     // delta+varint (doc, title tf, body tf) triples
+    prefix_nodes, // segment_prefix_node per trie node, breadth first
+    prefix_terms  // prefix_fanout term ids per trie node
+};
+
+struct segment_header
+{
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint64_t file_size;
+    std::uint32_t section_count;
+    std::uint32_t header_crc;
+};
+
+struct segment_section_entry
+{
+    std::uint32_t id;
+    std::uint32_t crc;
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+
+struct segment_stats
+{
+    std::uint64_t doc_count;
+    std::uint64_t total_tokens;
+    double average_length;
+};
+
+// The doc's strings are stored back to back in doc_strings, starting at
+// strings: url, title, format, tags, lang, body.
+struct segment_doc
+{
+    std::int64_t rowid;
+    std::int64_t updated_at;
+    std::uint64_t strings;
+    std::uint32_t url_size;
+    std::uint32_t title_size;
+    std::uint32_t format_size;
+    std::uint32_t tags_size;
+    std::uint32_t lang_size;
+    std::uint32_t body_size;
+};
+
+struct segment_term
+{
+    std::uint32_t text_offset;
+    std::uint32_t text_size;
+    std::uint32_t doc_freq;
+    std::uint32_t first_block;
+};
+
+// max_weight bounds the bm25 term weight of every posting in the block.
+struct segment_block
+{
+    std::uint32_t last_doc;
+    std::uint32_t offset;
+    float max_weight;
+};
+
+// A node of the byte trie over the dictionary. Only prefixes that expand to
+// more than prefix_fanout (meta) terms get a node; each lists its
+// prefix_fanout most frequent terms at top_offset in prefix_terms, in
+// dictionary order. Node 0 is the empty prefix.
+struct segment_prefix_node
+{
+    std::uint32_t label;
+    std::uint32_t first_child;
+    std::uint32_t child_count;
+    std::uint32_t top_offset;
+};
+
+static_assert(sizeof(segment_header) == 32U);
+static_assert(sizeof(segment_section_entry) == 24U);
+static_assert(sizeof(segment_doc) == 48U);
+static_assert(sizeof(segment_term) == 16U);
+static_assert(sizeof(segment_block) == 12U);
+static_assert(sizeof(segment_prefix_node) == 16U);
+}
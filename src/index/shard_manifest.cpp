@@ -0,0 +1,63 @@
+#include "shard_manifest.h"
+
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace retort
+{
+std::size_t shard_for_doc(std::string_view doc_id, std::size_t shard_count) {
+    // FNV-1a: stable across hosts and builds, unlike std::hash.
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (const char ch : doc_id) {
+        hash ^= static_cast<unsigned char>(ch);
+        hash *= 1099511628211ULL;
+    }
+    return static_cast<std::size_t>(hash % shard_count);
+}
+
+void write_shard_manifest(const std::filesystem::path &path, const std::vector<std::filesystem::path> &shard_files) {
+    std::ofstream stream{path, std::ios::binary | std::ios::trunc};
+    if (!stream) {
+        throw std::runtime_error("failed to write shard manifest: " + path.string());
+    }
+    stream << shard_manifest_magic << '\n';
+    for (const auto &file : shard_files) {
+        stream << file.filename().string() << '\n';
+    }
+    stream.flush();
+    if (!stream) {
+        throw std::runtime_error("failed to write shard manifest: " + path.string());
+    }
+}
+
+std::optional<std::vector<std::filesystem::path>> read_shard_manifest(const std::filesystem::path &path) {
+    std::ifstream stream{path, std::ios::binary};
+    if (!stream) {
+        throw std::runtime_error("failed to open index: " + path.string());
+    }
+    // Only the magic is compared, so a SQLite file is never read line-wise.
+    std::string header(shard_manifest_magic.size(), '\0');
+    stream.read(header.data(), static_cast<std::streamsize>(header.size()));
+    if (static_cast<std::size_t>(stream.gcount()) != header.size() || header != shard_manifest_magic) {
+        return std::nullopt;
+    }
+    std::string line;
+    std::getline(stream, line);
+    std::vector<std::filesystem::path> shards;
+    while (std::getline(stream, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty()) {
+            continue;
+        }
+        shards.push_back(path.parent_path() / line);
+    }
+    if (shards.empty()) {
+        throw std::runtime_error("shard manifest lists no shards: " + path.string());
+    }
+    return shards;
+}
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace retort
+{
+// A sharded index is published as a small text manifest at the output path:
+//
+//   retort-shards 1
+//   <shard file>      (one per line, relative to the manifest directory)
+//
+// Documents go to shard shard_for_doc(doc_id, count).
+constexpr std::string_view shard_manifest_magic{"retort-shards 1"};
+
+std::size_t shard_for_doc(std::string_view doc_id, std::size_t shard_count);
+
+void write_shard_manifest(const std::filesystem::path &path, const std::vector<std::filesystem::path> &shard_files);
+
+// Returns the shard paths when path is a manifest, std::nullopt when it is a
+// plain index file.
+std::optional<std::vector<std::filesystem::path>> read_shard_manifest(const std::filesystem::path &path);
+}
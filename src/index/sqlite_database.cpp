@@ -1,11 +1,68 @@
 #include "sqlite_database.h"
 
+#include "index/cjk_tokenizer.h"
+#include "index/doc_bitmap.h"
+#include "index/global_bm25.h"
+#include "util/compression.h"
+
+#include <cstdint>
+#include <exception>
+#include <string_view>
+#include <vector>
+
 namespace retort
 {
+namespace
+{
+// retort_inflate(blob) backs the schema v2 content view, so FTS5 can read the
+// compressed body column for snippet() and external-content maintenance.
+void sql_inflate(sqlite3_context *context, int, sqlite3_value **argv) {
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL) {
+        sqlite3_result_null(context);
+        return;
+    }
+    const auto *data = static_cast<const char *>(sqlite3_value_blob(argv[0]));
+    const auto size = static_cast<std::size_t>(sqlite3_value_bytes(argv[0]));
+    try {
+        const auto text = inflate_text(std::string_view{data, size});
+        sqlite3_result_text(context, text.data(), static_cast<int>(text.size()), SQLITE_TRANSIENT);
+    }
+    catch (const std::exception &ex) {
+        sqlite3_result_error(context, ex.what(), -1);
+    }
+}
+
+// retort_allowed(set, rowid) lets a search keep only filtered documents as
+// FTS5 produces them; a NULL or unbound set allows nothing.
+void sql_allowed(sqlite3_context *context, int, sqlite3_value **argv) {
+    const auto *set = static_cast<const std::vector<std::uint64_t> *>(sqlite3_value_pointer(argv[0], doc_set_pointer_type));
+    const auto rowid = sqlite3_value_int64(argv[1]);
+    sqlite3_result_int(context, set != nullptr && rowid >= 0 && dense_contains(*set, static_cast<std::uint64_t>(rowid)) ? 1 : 0);
+}
+}
+
 sqlite_database::sqlite_database(const std::string &path, int flags) {
     if (sqlite3_open_v2(path.c_str(), &db_, flags, nullptr) != SQLITE_OK) {
+        sqlite3_close(db_);
+        db_ = nullptr;
         throw std::runtime_error("failed to open sqlite database: " + path);
     }
+    const int function_flags = SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS;
+    if (sqlite3_create_function_v2(db_, "retort_inflate", 1, function_flags, nullptr, sql_inflate, nullptr, nullptr, nullptr) != SQLITE_OK ||
+        sqlite3_create_function_v2(db_, "retort_allowed", 2, SQLITE_UTF8 | SQLITE_INNOCUOUS, nullptr, sql_allowed, nullptr, nullptr, nullptr) != SQLITE_OK) {
+        sqlite3_close(db_);
+        db_ = nullptr;
+        throw std::runtime_error("failed to register sql functions: " + path);
+    }
+    try {
+        register_cjk_tokenizer(db_);
+        register_global_bm25(db_);
+    }
+    catch (...) {
+        sqlite3_close(db_);
+        db_ = nullptr;
+        throw;
+    }
 }
 
 sqlite_database::~sqlite_database() {
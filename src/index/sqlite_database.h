@@ -7,6 +7,10 @@
 
 namespace retort
 {
+// Pointer type under which a dense doc bitset (index/doc_bitmap.h) is bound
+// for retort_allowed(set, rowid), which is true when rowid is in the set.
+inline constexpr const char *doc_set_pointer_type = "retort_doc_set";
+
 class sqlite_database
 {
 public:
@@ -1,6 +1,7 @@
 #include "cli/cli_parser.h"
 #include "config/app_config.h"
 #include "writer/index_builder.h"
+#include "writer/index_watcher.h"
 
 #include <exception>
 #include <iostream>
@@ -17,22 +18,41 @@ void print_usage()
 Commands
   serve    Start HTTP search server
     --listen <addr>        Override listen host:port (default: 127.0.0.1:9000)
-    --index_path <path>    SQLite database path (required)
+    --index_path <path>    SQLite database, segment or shard manifest path (required)
     --threads <n>          Worker thread count (default: HW cores)
     --min_q <n>            Minimum query length (default: 2)
     --limit <n>            Default search limit (default: 20)
     --max_q_len <n>        Maximum allowed query length (default: 1024)
     --log_level <level>    Log level: silent | error | info | debug
+    --engine <name>        Query engine: sqlite | memory (default: sqlite)
+    --title_weight <x>     bm25 weight of the title column (default: 1)
+    --body_weight <x>      bm25 weight of the body column (default: 1)
+    --recency_boost <x>    Score multiplier for fresh documents: 1 + x * decay
+                           (default: 0, off)
+    --recency_half_life <d>
+                           Days for the recency decay to halve (default: 30)
 
   write    Build SQLite FTS index
     --src_dir <path>       Astro content directory
-    --repo <path>          Repository root (for git metadata)
+    --repo <path>          Repository root (last-commit times and HEAD via git log)
     --out <path>           Output SQLite file (required)
     --include-code         Include fenced code blocks in body
     --ngram <n>            Emit n-gram tokens (default: disabled)
+    --tokenizer <name>     unicode61 | cjk: bigrams for CJK runs (default: unicode61)
     --max-bytes <n>        Per-file size limit (default: 1048576)
+    --watch                Keep running and re-index changed files in place
+    --shards <n>           Split into n files built in parallel (default: 1)
+    --format <name>        Output format: sqlite | segment (default: sqlite)
+    --prefix-fanout <n>    Expand short prefixes to their n most frequent terms
+                           in the memory engine and segments (default: 0, all)
+    --prefix-index <list>  FTS5 prefix index lengths, e.g. '2 3 4' (default: none)
+    --trigram              Add a trigram index for substring search (substr=1)
+    --hot-prefixes <n>     Precompute the top n hits of every 2- and 3-character
+                           prefix (default: 0, off)
 
-Environment variables override serve options (e.g. RETORT_LISTEN).
+Environment variables override serve options (e.g. RETORT_LISTEN; ranking
+uses RETORT_TITLE_WEIGHT, RETORT_BODY_WEIGHT, RETORT_RECENCY_BOOST and
+RETORT_RECENCY_HALF_LIFE).
 
 Global options
   -h, --help        Show this help
@@ -70,7 +90,12 @@ int main(int argc, char **argv) {
         case retort::command_type::serve:
             return retort::run_server(parsed.serve);
         case retort::command_type::write:
-            retort::build_index(parsed.write);
+            if (parsed.write.watch) {
+                retort::watch_index(parsed.write);
+            }
+            else {
+                retort::build_index(parsed.write);
+            }
             return 0;
         }
     }
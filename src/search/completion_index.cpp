@@ -0,0 +1,142 @@
+#include "completion_index.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace retort
+{
+namespace
+{
+// Ranges up to this long are cheaper to scan than to precompute.
+constexpr std::size_t scan_limit = 256U;
+}
+
+completion_index::completion_index(sqlite3 *db)
+{
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, "SELECT term, weight FROM completions ORDER BY term", -1, &stmt, nullptr) != SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        return;
+    }
+    offsets_.push_back(0U);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const auto *text = static_cast<const char *>(sqlite3_column_blob(stmt, 0));
+        text_.append(text, static_cast<std::size_t>(sqlite3_column_bytes(stmt, 0)));
+        offsets_.push_back(static_cast<std::uint32_t>(text_.size()));
+        weights_.push_back(static_cast<std::uint32_t>(sqlite3_column_int64(stmt, 1)));
+    }
+    sqlite3_finalize(stmt);
+    if (!weights_.empty()) {
+        annotate(0U, weights_.size(), 0U);
+    }
+}
+
+bool completion_index::empty() const noexcept
+{
+    return weights_.empty();
+}
+
+std::string_view completion_index::word(std::size_t index) const
+{
+    return std::string_view{text_}.substr(offsets_[index], offsets_[index + 1U] - offsets_[index]);
+}
+
+std::vector<std::uint32_t> completion_index::heaviest(std::vector<std::uint32_t> candidates, std::size_t limit) const
+{
+    const auto count = std::min(limit, candidates.size());
+    std::partial_sort(candidates.begin(),
+                      candidates.begin() + static_cast<std::ptrdiff_t>(count),
+                      candidates.end(),
+                      [this](std::uint32_t lhs, std::uint32_t rhs) {
+                          return weights_[lhs] != weights_[rhs] ? weights_[lhs] > weights_[rhs] : lhs < rhs;
+                      });
+    candidates.resize(count);
+    return candidates;
+}
+
+// Returns the top words of [first, last), whose words share depth bytes, and
+// stores them under that prefix when the range is too long to scan. A long
+// range's top comes from its children's, so each word is scanned once.
+std::vector<std::uint32_t> completion_index::annotate(std::size_t first, std::size_t last, std::size_t depth)
+{
+    if (last - first <= scan_limit) {
+        std::vector<std::uint32_t> range(last - first);
+        std::iota(range.begin(), range.end(), static_cast<std::uint32_t>(first));
+        return heaviest(std::move(range), max_completions);
+    }
+    std::vector<std::uint32_t> candidates;
+    std::size_t pos = first;
+    if (word(pos).size() == depth) {
+        candidates.push_back(static_cast<std::uint32_t>(pos));
+        ++pos;
+    }
+    while (pos < last) {
+        const auto byte = static_cast<unsigned char>(word(pos)[depth]);
+        std::size_t low = pos + 1U;
+        std::size_t high = last;
+        while (low < high) {
+            const auto mid = low + (high - low) / 2U;
+            if (static_cast<unsigned char>(word(mid)[depth]) <= byte) {
+                low = mid + 1U;
+            }
+            else {
+                high = mid;
+            }
+        }
+        const auto child = annotate(pos, low, depth + 1U);
+        candidates.insert(candidates.end(), child.begin(), child.end());
+        pos = low;
+    }
+    auto top = heaviest(std::move(candidates), max_completions);
+    top_.emplace(std::string{word(first).substr(0U, depth)}, top);
+    return top;
+}
+
+std::vector<std::string> completion_index::complete(std::string_view prefix, std::size_t limit) const
+{
+    limit = std::min(limit, max_completions);
+    std::size_t low = 0U;
+    std::size_t high = weights_.size();
+    while (low < high) {
+        const auto mid = low + (high - low) / 2U;
+        if (word(mid) < prefix) {
+            low = mid + 1U;
+        }
+        else {
+            high = mid;
+        }
+    }
+    const auto first = low;
+    high = weights_.size();
+    while (low < high) {
+        const auto mid = low + (high - low) / 2U;
+        if (word(mid).starts_with(prefix)) {
+            low = mid + 1U;
+        }
+        else {
+            high = mid;
+        }
+    }
+    const auto last = low;
+
+    std::vector<std::uint32_t> top;
+    if (last - first > scan_limit) {
+        const auto it = top_.find(prefix);
+        if (it != top_.end()) {
+            top.assign(it->second.begin(), it->second.begin() + static_cast<std::ptrdiff_t>(std::min(limit, it->second.size())));
+        }
+    }
+    else {
+        std::vector<std::uint32_t> range(last - first);
+        std::iota(range.begin(), range.end(), static_cast<std::uint32_t>(first));
+        top = heaviest(std::move(range), limit);
+    }
+
+    std::vector<std::string> words;
+    words.reserve(top.size());
+    for (const auto index : top) {
+        words.emplace_back(word(index));
+    }
+    return words;
+}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <sqlite3.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace retort
+{
+constexpr std::size_t max_completions = 16U;
+
+// The words the writer picked for autocompletion (the completions table),
+// sorted by bytes, each with a weight. A prefix's words are a contiguous
+// range found by binary search; short ranges are scanned for their heaviest
+// words, and every prefix whose range is longer than that has its top
+// max_completions precomputed when the index is loaded.
+class completion_index
+{
+public:
+    completion_index() = default;
+    // Empty when the index has no completions table.
+    explicit completion_index(sqlite3 *db);
+
+    bool empty() const noexcept;
+
+    // Up to limit (at most max_completions) words starting with prefix,
+    // heaviest first and in byte order among equal weights.
+    std::vector<std::string> complete(std::string_view prefix, std::size_t limit) const;
+
+private:
+    std::string_view word(std::size_t index) const;
+    std::vector<std::uint32_t> heaviest(std::vector<std::uint32_t> candidates, std::size_t limit) const;
+    std::vector<std::uint32_t> annotate(std::size_t first, std::size_t last, std::size_t depth);
+
+    std::string text_;
+    std::vector<std::uint32_t> offsets_;
+    std::vector<std::uint32_t> weights_;
+    std::map<std::string, std::vector<std::uint32_t>, std::less<>> top_;
+};
+}
@@ -0,0 +1,97 @@
+#include "facet_index.h"
+
+#include <algorithm>
+#include <span>
+
+namespace retort
+{
+void sort_counts(std::vector<facet_count> &counts) {
+    std::sort(counts.begin(), counts.end(), [](const facet_count &lhs, const facet_count &rhs) {
+        return lhs.count != rhs.count ? lhs.count > rhs.count : lhs.value < rhs.value;
+    });
+}
+
+bool search_filter::empty() const noexcept
+{
+    return tags.empty() && lang.empty() && format.empty();
+}
+
+facet_index::facet_index(sqlite3 *db)
+{
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, "SELECT kind, value, bitmap FROM facet_bitmaps", -1, &stmt, nullptr) != SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        return;
+    }
+    try {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            std::string kind = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+            std::string value{reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1)),
+                              static_cast<std::size_t>(sqlite3_column_bytes(stmt, 1))};
+            const auto *data = static_cast<const std::uint8_t *>(sqlite3_column_blob(stmt, 2));
+            auto bitmap = doc_bitmap::deserialize(std::span<const std::uint8_t>{data, static_cast<std::size_t>(sqlite3_column_bytes(stmt, 2))});
+            bitmaps_.emplace(std::pair{std::move(kind), std::move(value)}, std::move(bitmap));
+        }
+    }
+    catch (...) {
+        sqlite3_finalize(stmt);
+        throw;
+    }
+    sqlite3_finalize(stmt);
+}
+
+bool facet_index::empty() const noexcept
+{
+    return bitmaps_.empty();
+}
+
+const doc_bitmap *facet_index::find(const std::string &kind, const std::string &value) const
+{
+    const auto it = bitmaps_.find(std::pair{kind, value});
+    return it == bitmaps_.end() ? nullptr : &it->second;
+}
+
+std::vector<std::uint64_t> facet_index::resolve(const search_filter &filter) const
+{
+    std::vector<const doc_bitmap *> parts;
+    const auto add = [&](const char *kind, const std::string &value) {
+        parts.push_back(find(kind, value));
+    };
+    for (const auto &tag : filter.tags) {
+        add("tag", tag);
+    }
+    if (!filter.lang.empty()) {
+        add("lang", filter.lang);
+    }
+    if (!filter.format.empty()) {
+        add("format", filter.format);
+    }
+    if (parts.empty() || std::find(parts.begin(), parts.end(), nullptr) != parts.end()) {
+        return {};
+    }
+
+    // Start from the smallest set; the rest only clear bits.
+    std::sort(parts.begin(), parts.end(), [](const doc_bitmap *lhs, const doc_bitmap *rhs) {
+        return lhs->cardinality() < rhs->cardinality();
+    });
+    std::vector<std::uint64_t> dense(parts.front()->dense_words(), 0U);
+    parts.front()->fill_dense(dense);
+    for (std::size_t i = 1U; i < parts.size(); ++i) {
+        parts[i]->intersect_dense(dense);
+    }
+    return dense;
+}
+
+std::vector<facet_count> facet_index::count(std::string_view kind, std::span<const std::uint64_t> set) const
+{
+    std::vector<facet_count> counts;
+    for (auto it = bitmaps_.lower_bound(std::pair{std::string{kind}, std::string{}}); it != bitmaps_.end() && it->first.first == kind; ++it) {
+        const auto docs = it->second.count_and(set);
+        if (docs > 0U) {
+            counts.push_back(facet_count{it->first.second, docs});
+        }
+    }
+    sort_counts(counts);
+    return counts;
+}
+}
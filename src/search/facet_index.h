@@ -0,0 +1,61 @@
+#pragma once
+
+#include "index/doc_bitmap.h"
+
+#include <sqlite3.h>
+
+#include <cstdint>
+#include <map>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace retort
+{
+// Restricts a search to documents carrying every listed tag and the given
+// lang and format; empty fields do not restrict.
+struct search_filter
+{
+    std::vector<std::string> tags;
+    std::string lang;
+    std::string format;
+
+    bool empty() const noexcept;
+};
+
+struct facet_count
+{
+    std::string value;
+    std::size_t count = 0U;
+};
+
+// Most first, then by value.
+void sort_counts(std::vector<facet_count> &counts);
+
+// The writer's facet_bitmaps table: one compressed doc bitmap per tag, lang
+// and format value, loaded at startup.
+class facet_index
+{
+public:
+    facet_index() = default;
+    // Empty when the index has no facet_bitmaps table.
+    explicit facet_index(sqlite3 *db);
+
+    bool empty() const noexcept;
+
+    // The rowids matching filter as a dense bitset (see dense_contains); a
+    // value no document has yields the empty set.
+    std::vector<std::uint64_t> resolve(const search_filter &filter) const;
+
+    // Every value of kind ("tag", "lang" or "format") carried by a doc in
+    // set, with how many such docs, in sort_counts order.
+    std::vector<facet_count> count(std::string_view kind, std::span<const std::uint64_t> set) const;
+
+private:
+    const doc_bitmap *find(const std::string &kind, const std::string &value) const;
+
+    std::map<std::pair<std::string, std::string>, doc_bitmap> bitmaps_;
+};
+}
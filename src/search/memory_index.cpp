@@ -0,0 +1,1066 @@
+#include "memory_index.h"
+
+#include "index/doc_bitmap.h"
+#include "index/schema_migration.h"
+#include "search/posting_kernels.h"
+#include "util/compression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace retort
+{
+namespace
+{
+constexpr std::size_t block_size = 128U;
+constexpr int snippet_tokens = 24;
+constexpr double bm25_k1 = 1.2;
+constexpr double bm25_b = 0.75;
+
+struct posting
+{
+    std::uint32_t doc = 0U;
+    std::uint32_t title_tf = 0U;
+    std::uint32_t body_tf = 0U;
+};
+
+void put_varint(std::vector<std::uint8_t> &out, std::uint32_t value) {
+    while (value >= 0x80U) {
+        out.push_back(static_cast<std::uint8_t>(value | 0x80U));
+        value >>= 7;
+    }
+    out.push_back(static_cast<std::uint8_t>(value));
+}
+
+std::uint32_t get_varint(const std::uint8_t *&data) {
+    std::uint32_t value = 0U;
+    int shift = 0;
+    while ((*data & 0x80U) != 0U) {
+        value |= static_cast<std::uint32_t>(*data++ & 0x7FU) << shift;
+        shift += 7;
+    }
+    value |= static_cast<std::uint32_t>(*data++) << shift;
+    return value;
+}
+
+template <typename Range>
+std::span<const std::uint8_t> bytes_of(const Range &range) {
+    return {reinterpret_cast<const std::uint8_t *>(std::data(range)), std::size(range) * sizeof(*std::data(range))};
+}
+
+std::string column_text(sqlite3_stmt *stmt, int column) {
+    const auto *text = sqlite3_column_text(stmt, column);
+    return text != nullptr ? reinterpret_cast<const char *>(text) : std::string{};
+}
+
+// FTS5 barewords: ASCII letters, digits, '_', 0x1A and any non-ASCII byte.
+bool is_bareword(std::string_view token) {
+    if (token.empty() || token == "AND" || token == "OR" || token == "NOT" || token == "NEAR") {
+        return false;
+    }
+    return std::all_of(token.begin(), token.end(), [](char ch) {
+        const auto byte = static_cast<unsigned char>(ch);
+        return byte >= 0x80U || (byte >= '0' && byte <= '9') || (byte >= 'a' && byte <= 'z') ||
+               (byte >= 'A' && byte <= 'Z') || byte == '_' || byte == 0x1AU;
+    });
+}
+
+bool matches(std::string_view token, const std::string &term, bool prefix) {
+    return prefix ? token.starts_with(term) : token == term;
+}
+
+// The per-phrase factor of FTS5's bm25(), before it is scaled by idf. It
+// grows with f and shrinks with the document length.
+double bm25_weight(double f, double length, double average_length) {
+    return (f * (bm25_k1 + 1.0)) / (f + bm25_k1 * (1 - bm25_b + bm25_b * length / average_length));
+}
+
+// Block bounds are stored as float; round up so they never undercut the
+// double-precision weight they stand for.
+float upper_bound_of(double value) {
+    const auto rounded = static_cast<float>(value);
+    return static_cast<double>(rounded) >= value ? rounded : std::nextafter(rounded, std::numeric_limits<float>::infinity());
+}
+
+// Breadth-first over the sorted dictionary, so the children of a node are
+// contiguous and ordered by label. A prefix whose range holds no more than
+// fanout terms gets no node: its full expansion is already small.
+void build_prefix_trie(const std::vector<std::string_view> &names,
+                       const std::vector<segment_term> &terms,
+                       std::size_t fanout,
+                       std::vector<segment_prefix_node> &nodes,
+                       std::vector<std::uint32_t> &top) {
+    struct pending
+    {
+        std::uint32_t node = 0U;
+        std::uint32_t first = 0U;
+        std::uint32_t last = 0U;
+        std::size_t depth = 0U;
+    };
+    if (fanout == 0U || terms.size() <= fanout) {
+        return;
+    }
+    nodes.push_back(segment_prefix_node{0U, 0U, 0U, 0U});
+    std::deque<pending> queue{pending{0U, 0U, static_cast<std::uint32_t>(terms.size()), 0U}};
+    std::vector<std::uint32_t> ids;
+    const auto more_frequent = [&terms](std::uint32_t lhs, std::uint32_t rhs) {
+        return terms[lhs].doc_freq > terms[rhs].doc_freq || (terms[lhs].doc_freq == terms[rhs].doc_freq && lhs < rhs);
+    };
+    while (!queue.empty()) {
+        const auto current = queue.front();
+        queue.pop_front();
+
+        ids.resize(current.last - current.first);
+        std::iota(ids.begin(), ids.end(), current.first);
+        const auto kept = ids.begin() + static_cast<std::ptrdiff_t>(fanout);
+        std::partial_sort(ids.begin(), kept, ids.end(), more_frequent);
+        std::sort(ids.begin(), kept);
+        nodes[current.node].top_offset = static_cast<std::uint32_t>(top.size());
+        top.insert(top.end(), ids.begin(), kept);
+
+        nodes[current.node].first_child = static_cast<std::uint32_t>(nodes.size());
+        auto t = current.first;
+        while (t < current.last && names[t].size() == current.depth) {
+            ++t;
+        }
+        while (t < current.last) {
+            const auto label = static_cast<unsigned char>(names[t][current.depth]);
+            auto end = t;
+            while (end < current.last && static_cast<unsigned char>(names[end][current.depth]) == label) {
+                ++end;
+            }
+            if (end - t > fanout) {
+                queue.push_back(pending{static_cast<std::uint32_t>(nodes.size()), t, end, current.depth + 1U});
+                nodes.push_back(segment_prefix_node{label, 0U, 0U, 0U});
+            }
+            t = end;
+        }
+        nodes[current.node].child_count = static_cast<std::uint32_t>(nodes.size()) - nodes[current.node].first_child;
+    }
+}
+
+struct ranked_doc
+{
+    double score = 0.0;
+    std::uint32_t doc = 0U;
+};
+
+// bm25() scores are negative; ties keep rowid order like FTS5's sorter.
+bool ranks_before(const ranked_doc &lhs, const ranked_doc &rhs) {
+    return lhs.score < rhs.score || (lhs.score == rhs.score && lhs.doc < rhs.doc);
+}
+}
+
+std::vector<std::uint8_t> build_segment(sqlite_database &database) {
+    sqlite3 *db = database.handle();
+
+    // Indexes written before the tokenizer became configurable have no
+    // "tokenizer" row; they all use the default one.
+    std::string meta;
+    std::string tokenizer_name;
+    std::size_t prefix_fanout = 0U;
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, "SELECT key, value FROM meta ORDER BY key", -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("failed to read meta rows");
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const auto key = column_text(stmt, 0);
+        const auto value = column_text(stmt, 1);
+        if (key == "prefix_fanout") {
+            prefix_fanout = static_cast<std::size_t>(std::stoull(value));
+        }
+        else if (key == "tokenizer") {
+            tokenizer_name = value;
+        }
+        meta.append(key).push_back('\0');
+        meta.append(value).push_back('\0');
+    }
+    sqlite3_finalize(stmt);
+    if (tokenizer_name.empty()) {
+        tokenizer_name = fts_tokenizer_name;
+        meta.append("tokenizer").push_back('\0');
+        meta.append(tokenizer_name).push_back('\0');
+    }
+    const fts5_tokenizer_handle tokenizer{db, tokenizer_name};
+
+    const char *sql =
+        "SELECT id, url, title, format, tags, lang, updated_at, body"
+        " FROM docs ORDER BY id";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("memory engine requires schema version 2");
+    }
+
+    std::vector<segment_doc> docs;
+    std::string doc_strings;
+    std::vector<std::uint32_t> lengths;
+    std::unordered_map<std::string, std::uint32_t> term_ids;
+    std::vector<std::string> term_names;
+    std::vector<std::vector<posting>> lists;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> occurrences;
+    std::uint64_t total_tokens = 0U;
+
+    const auto add_tokens = [&](std::string_view text, std::uint32_t column) {
+        tokenizer.for_each_token(text, FTS5_TOKENIZE_DOCUMENT, [&](std::string_view token, int, int) {
+            auto [it, inserted] = term_ids.try_emplace(std::string{token}, static_cast<std::uint32_t>(term_names.size()));
+            if (inserted) {
+                term_names.emplace_back(token);
+                lists.emplace_back();
+            }
+            occurrences.emplace_back(it->second, column);
+        });
+    };
+    const auto add_string = [&doc_strings](std::string_view text) {
+        doc_strings.append(text);
+        return static_cast<std::uint32_t>(text.size());
+    };
+
+    while (true) {
+        const int step = sqlite3_step(stmt);
+        if (step == SQLITE_DONE) {
+            break;
+        }
+        if (step != SQLITE_ROW) {
+            sqlite3_finalize(stmt);
+            throw std::runtime_error("failed to load documents");
+        }
+        const auto title = column_text(stmt, 2);
+        const auto *blob = static_cast<const char *>(sqlite3_column_blob(stmt, 7));
+        const std::string_view body_blob{blob != nullptr ? blob : "", static_cast<std::size_t>(sqlite3_column_bytes(stmt, 7))};
+
+        segment_doc doc{};
+        doc.rowid = sqlite3_column_int64(stmt, 0);
+        doc.updated_at = sqlite3_column_int64(stmt, 6);
+        doc.strings = doc_strings.size();
+        doc.url_size = add_string(column_text(stmt, 1));
+        doc.title_size = add_string(title);
+        doc.format_size = add_string(column_text(stmt, 3));
+        doc.tags_size = add_string(column_text(stmt, 4));
+        doc.lang_size = add_string(column_text(stmt, 5));
+        doc.body_size = add_string(body_blob);
+
+        occurrences.clear();
+        add_tokens(title, 0U);
+        add_tokens(inflate_text(body_blob), 1U);
+        lengths.push_back(static_cast<std::uint32_t>(occurrences.size()));
+        total_tokens += occurrences.size();
+
+        const auto doc_number = static_cast<std::uint32_t>(docs.size());
+        std::sort(occurrences.begin(), occurrences.end());
+        for (const auto &[term, column] : occurrences) {
+            auto &list = lists[term];
+            if (list.empty() || list.back().doc != doc_number) {
+                list.push_back(posting{doc_number, 0U, 0U});
+            }
+            ++(column == 0U ? list.back().title_tf : list.back().body_tf);
+        }
+        docs.push_back(doc);
+    }
+    sqlite3_finalize(stmt);
+
+    const double average_length = docs.empty() ? 0.0 : static_cast<double>(total_tokens) / static_cast<double>(docs.size());
+
+    std::vector<std::uint32_t> order(term_names.size());
+    for (std::uint32_t i = 0U; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&term_names](std::uint32_t lhs, std::uint32_t rhs) {
+        return term_names[lhs] < term_names[rhs];
+    });
+
+    std::vector<segment_term> terms;
+    std::string term_text;
+    std::vector<segment_block> blocks;
+    std::vector<std::uint8_t> postings;
+    terms.reserve(order.size());
+    for (const auto id : order) {
+        const auto &list = lists[id];
+        segment_term term{};
+        term.text_offset = static_cast<std::uint32_t>(term_text.size());
+        term.text_size = static_cast<std::uint32_t>(term_names[id].size());
+        term.doc_freq = static_cast<std::uint32_t>(list.size());
+        term.first_block = static_cast<std::uint32_t>(blocks.size());
+        term_text.append(term_names[id]);
+
+        std::uint32_t previous = 0U;
+        for (std::size_t i = 0U; i < list.size(); ++i) {
+            if (i % block_size == 0U) {
+                blocks.push_back(segment_block{0U, static_cast<std::uint32_t>(postings.size()), 0.0F});
+            }
+            put_varint(postings, list[i].doc - previous);
+            put_varint(postings, list[i].title_tf);
+            put_varint(postings, list[i].body_tf);
+            previous = list[i].doc;
+            auto &block = blocks.back();
+            block.last_doc = previous;
+            const auto weight = bm25_weight(list[i].title_tf + list[i].body_tf, lengths[previous], average_length);
+            block.max_weight = std::max(block.max_weight, upper_bound_of(weight));
+        }
+        terms.push_back(term);
+        std::vector<posting>{}.swap(lists[id]);
+        if (postings.size() > std::numeric_limits<std::uint32_t>::max()) {
+            throw std::runtime_error("posting data exceeds the segment limit of 4 GiB");
+        }
+    }
+
+    std::vector<std::string_view> sorted_names(order.size());
+    for (std::size_t i = 0U; i < order.size(); ++i) {
+        sorted_names[i] = term_names[order[i]];
+    }
+    std::vector<segment_prefix_node> prefix_nodes;
+    std::vector<std::uint32_t> prefix_terms;
+    build_prefix_trie(sorted_names, terms, prefix_fanout, prefix_nodes, prefix_terms);
+
+    const segment_stats stats{docs.size(), total_tokens, average_length};
+    const segment_part parts[] = {
+        {segment_section::meta, bytes_of(meta)},
+        {segment_section::stats, bytes_of(std::span{&stats, 1U})},
+        {segment_section::docs, bytes_of(docs)},
+        {segment_section::doc_strings, bytes_of(doc_strings)},
+        {segment_section::lengths, bytes_of(lengths)},
+        {segment_section::terms, bytes_of(terms)},
+        {segment_section::term_text, bytes_of(term_text)},
+        {segment_section::blocks, bytes_of(blocks)},
+        {segment_section::postings, bytes_of(postings)},
+        {segment_section::prefix_nodes, bytes_of(prefix_nodes)},
+        {segment_section::prefix_terms, bytes_of(prefix_terms)},
+    };
+    return pack_segment(parts);
+}
+
+memory_index::memory_index(sqlite_database &database)
+    : image_{build_segment(database)},
+      segment_{image_},
+      tokenizer_{database.handle(), std::string{segment_.meta("tokenizer").value_or(fts_tokenizer_name)}}
+{
+    attach();
+}
+
+// The tokenizer only needs an FTS5 module to come from, so a private
+// in-memory connection serves a mapped segment.
+memory_index::memory_index(const std::filesystem::path &segment_path)
+    : mapping_{segment_path},
+      segment_{mapping_.bytes()},
+      tokenizer_database_{std::make_unique<sqlite_database>(":memory:")},
+      tokenizer_{tokenizer_database_->handle(), std::string{segment_.meta("tokenizer").value_or(fts_tokenizer_name)}}
+{
+    attach();
+}
+
+void memory_index::attach()
+{
+    const auto stats = segment_.records<segment_stats>(segment_section::stats);
+    const auto strings = segment_.section(segment_section::doc_strings);
+    const auto text = segment_.section(segment_section::term_text);
+    docs_ = segment_.records<segment_doc>(segment_section::docs);
+    doc_strings_ = {reinterpret_cast<const char *>(strings.data()), strings.size()};
+    lengths_ = segment_.records<std::uint32_t>(segment_section::lengths);
+    terms_ = segment_.records<term_entry>(segment_section::terms);
+    term_text_ = {reinterpret_cast<const char *>(text.data()), text.size()};
+    blocks_ = segment_.records<segment_block>(segment_section::blocks);
+    postings_ = segment_.section(segment_section::postings);
+    prefix_nodes_ = segment_.records<segment_prefix_node>(segment_section::prefix_nodes);
+    prefix_terms_ = segment_.records<std::uint32_t>(segment_section::prefix_terms);
+    prefix_fanout_ = static_cast<std::size_t>(std::stoull(std::string{segment_.meta("prefix_fanout").value_or("0")}));
+    if (stats.size() != 1U || stats.front().doc_count != docs_.size() || lengths_.size() != docs_.size() ||
+        prefix_terms_.size() != prefix_nodes_.size() * prefix_fanout_) {
+        throw std::runtime_error("corrupt segment");
+    }
+    total_tokens_ = stats.front().total_tokens;
+    average_length_ = stats.front().average_length;
+}
+
+memory_index::stored_doc memory_index::read_doc(const segment_doc &doc) const
+{
+    auto offset = static_cast<std::size_t>(doc.strings);
+    const auto take = [this, &offset](std::uint32_t size) {
+        const auto field = doc_strings_.substr(offset, size);
+        offset += size;
+        return field;
+    };
+    stored_doc result;
+    result.url = take(doc.url_size);
+    result.title = take(doc.title_size);
+    result.format = take(doc.format_size);
+    result.tags_json = take(doc.tags_size);
+    result.lang = take(doc.lang_size);
+    result.body_blob = take(doc.body_size);
+    return result;
+}
+
+std::size_t memory_index::doc_count() const noexcept
+{
+    return docs_.size();
+}
+
+meta_info memory_index::load_meta() const
+{
+    meta_info info;
+    info.schema_version = std::string{segment_.meta("schema_version").value_or("1")};
+    info.repo_commit = std::string{segment_.meta("repo_commit").value_or("")};
+    info.built_at = std::string{segment_.meta("built_at").value_or("")};
+    info.doc_count = docs_.size();
+    info.prefix_index = parse_prefix_index_meta(std::string{segment_.meta("prefix_index").value_or("")});
+    return info;
+}
+
+std::string_view memory_index::term_text(const term_entry &term) const
+{
+    return term_text_.substr(term.text_offset, term.text_size);
+}
+
+double memory_index::weight(std::uint32_t freq, std::uint32_t doc, double average_length) const
+{
+    return bm25_weight(freq, lengths_[doc], average_length);
+}
+
+// Walks one phrase's postings in doc order. A single dictionary term is read
+// straight from its coded blocks, decoding a block only when a candidate
+// lands in it; a prefix union is materialized first and cut into blocks of
+// the same size, each bounded by the weight of its largest frequency at its
+// shortest length.
+class memory_index::phrase_cursor
+{
+public:
+    static constexpr std::uint32_t end = std::numeric_limits<std::uint32_t>::max();
+
+    phrase_cursor(const memory_index &index, const term_entry &term)
+        : index_{&index},
+          term_{&term},
+          size_{term.doc_freq},
+          block_count_{static_cast<std::uint32_t>((term.doc_freq + block_size - 1U) / block_size)}
+    {
+    }
+
+    phrase_cursor(const memory_index &index, phrase_postings postings)
+        : index_{&index},
+          postings_{std::move(postings)},
+          size_{postings_.docs.size()},
+          block_count_{static_cast<std::uint32_t>((size_ + block_size - 1U) / block_size)}
+    {
+        bounds_.resize(block_count_);
+        for (std::uint32_t b = 0U; b < block_count_; ++b) {
+            std::uint32_t max_freq = 0U;
+            std::uint32_t min_length = std::numeric_limits<std::uint32_t>::max();
+            const auto last = std::min(size_, (b + 1U) * block_size);
+            for (std::size_t i = b * block_size; i < last; ++i) {
+                max_freq = std::max(max_freq, postings_.freqs[i]);
+                min_length = std::min(min_length, index.lengths_[postings_.docs[i]]);
+            }
+            bounds_[b] = upper_bound_of(bm25_weight(max_freq, min_length, index.average_length_));
+        }
+    }
+
+    std::size_t size() const noexcept
+    {
+        return size_;
+    }
+
+    // Moves to the first block that can hold target without decoding it.
+    bool shallow(std::uint32_t target)
+    {
+        while (block_ < block_count_ && block_last() < target) {
+            ++block_;
+        }
+        return block_ < block_count_;
+    }
+
+    std::uint32_t block_last() const
+    {
+        if (term_ != nullptr) {
+            return index_->blocks_[term_->first_block + block_].last_doc;
+        }
+        return postings_.docs[std::min(size_, (block_ + 1U) * block_size) - 1U];
+    }
+
+    float block_bound() const
+    {
+        return term_ != nullptr ? index_->blocks_[term_->first_block + block_].max_weight : bounds_[block_];
+    }
+
+    std::uint32_t next_geq(std::uint32_t target)
+    {
+        if (!shallow(target)) {
+            return end;
+        }
+        if (loaded_ != block_) {
+            load_block();
+        }
+        while (docs_[pos_] < target) {
+            ++pos_;
+        }
+        return docs_[pos_];
+    }
+
+    std::uint32_t freq() const
+    {
+        return freqs_[pos_];
+    }
+
+private:
+    void load_block()
+    {
+        if (term_ != nullptr) {
+            index_->decode_block(*term_, block_, doc_buffer_, freq_buffer_);
+            docs_ = doc_buffer_;
+            freqs_ = freq_buffer_;
+        }
+        else {
+            docs_ = postings_.docs.data() + block_ * block_size;
+            freqs_ = postings_.freqs.data() + block_ * block_size;
+        }
+        loaded_ = block_;
+        pos_ = 0U;
+    }
+
+    const memory_index *index_ = nullptr;
+    const term_entry *term_ = nullptr;
+    phrase_postings postings_;
+    std::vector<float> bounds_;
+    std::size_t size_ = 0U;
+    std::uint32_t block_count_ = 0U;
+    std::uint32_t block_ = 0U;
+    std::uint32_t loaded_ = end;
+    std::size_t pos_ = 0U;
+    const std::uint32_t *docs_ = nullptr;
+    const std::uint32_t *freqs_ = nullptr;
+    std::uint32_t doc_buffer_[block_size]{};
+    std::uint32_t freq_buffer_[block_size]{};
+};
+
+std::optional<std::vector<memory_index::query_term>> memory_index::parse_query(const std::string &query) const
+{
+    std::vector<query_term> terms;
+    std::size_t pos = 0U;
+    while (pos < query.size()) {
+        const auto begin = query.find_first_not_of(" \t\r\n", pos);
+        if (begin == std::string::npos) {
+            break;
+        }
+        auto end = query.find_first_of(" \t\r\n", begin);
+        if (end == std::string::npos) {
+            end = query.size();
+        }
+        pos = end;
+
+        std::string_view word{query.data() + begin, end - begin};
+        const bool prefix = word.ends_with('*');
+        if (prefix) {
+            word.remove_suffix(1U);
+        }
+        if (!is_bareword(word)) {
+            return std::nullopt;
+        }
+        const int flags = FTS5_TOKENIZE_QUERY | (prefix ? FTS5_TOKENIZE_PREFIX : 0);
+        auto tokens = tokenizer_.tokenize(word, flags);
+        if (tokens.size() != 1U) {
+            return std::nullopt;
+        }
+        terms.push_back(query_term{std::move(tokens.front().text), prefix});
+    }
+    if (terms.empty()) {
+        return std::nullopt;
+    }
+    return terms;
+}
+
+std::pair<std::size_t, std::size_t> memory_index::term_range(const query_term &term) const
+{
+    const auto first = std::lower_bound(terms_.begin(), terms_.end(), term.text, [this](const term_entry &entry, const std::string &text) {
+        return term_text(entry) < text;
+    });
+    auto last = first;
+    while (last != terms_.end() && matches(term_text(*last), term.text, term.prefix)) {
+        ++last;
+        if (!term.prefix) {
+            break;
+        }
+    }
+    return {static_cast<std::size_t>(first - terms_.begin()), static_cast<std::size_t>(last - terms_.begin())};
+}
+
+std::span<const std::uint32_t> memory_index::top_expansions(std::string_view prefix) const
+{
+    if (prefix_nodes_.empty()) {
+        return {};
+    }
+    std::size_t node = 0U;
+    for (const char ch : prefix) {
+        const auto &parent = prefix_nodes_[node];
+        const auto children = prefix_nodes_.subspan(parent.first_child, parent.child_count);
+        const auto label = static_cast<unsigned char>(ch);
+        const auto it = std::lower_bound(children.begin(), children.end(), label, [](const segment_prefix_node &child, unsigned char value) {
+            return child.label < value;
+        });
+        if (it == children.end() || it->label != label) {
+            return {};
+        }
+        node = parent.first_child + static_cast<std::size_t>(it - children.begin());
+    }
+    return prefix_terms_.subspan(prefix_nodes_[node].top_offset, prefix_fanout_);
+}
+
+std::size_t memory_index::decode_block(const term_entry &term, std::uint32_t block, std::uint32_t *docs, std::uint32_t *freqs) const
+{
+    const auto index = term.first_block + block;
+    const std::size_t count = std::min<std::size_t>(block_size, term.doc_freq - block * block_size);
+    std::uint32_t doc = block == 0U ? 0U : blocks_[index - 1U].last_doc;
+    const std::uint8_t *data = postings_.data() + blocks_[index].offset;
+    for (std::size_t i = 0U; i < count; ++i) {
+        doc += get_varint(data);
+        const auto title_tf = get_varint(data);
+        const auto body_tf = get_varint(data);
+        docs[i] = doc;
+        freqs[i] = title_tf + body_tf;
+    }
+    return count;
+}
+
+std::vector<std::uint32_t> memory_index::term_docs(const term_entry &term) const
+{
+    std::vector<std::uint32_t> docs(term.doc_freq);
+    std::uint32_t freqs[block_size];
+    const auto blocks = static_cast<std::uint32_t>((term.doc_freq + block_size - 1U) / block_size);
+    for (std::uint32_t b = 0U; b < blocks; ++b) {
+        decode_block(term, b, docs.data() + b * block_size, freqs);
+    }
+    return docs;
+}
+
+// A prefix phrase matches the union of every term in its dictionary range,
+// or of its most frequent expansions when the trie caps it; FTS5 counts
+// each matching token as one instance, so frequencies add up.
+memory_index::phrase_postings memory_index::collect_phrase(const query_term &term) const
+{
+    const auto [first, last] = term_range(term);
+    std::vector<std::uint32_t> expansion;
+    const auto top = term.prefix ? top_expansions(term.text) : std::span<const std::uint32_t>{};
+    if (!top.empty()) {
+        expansion.assign(top.begin(), top.end());
+    }
+    else {
+        expansion.resize(last - first);
+        std::iota(expansion.begin(), expansion.end(), static_cast<std::uint32_t>(first));
+    }
+    std::size_t total = 0U;
+    for (const auto t : expansion) {
+        total += terms_[t].doc_freq;
+    }
+
+    phrase_postings result;
+    // Broad expansions add into one counter per document, which comes out
+    // in doc order; narrow ones decode each term and merge the lists.
+    if (total * 16U >= docs_.size()) {
+        std::vector<std::uint32_t> sums(docs_.size(), 0U);
+        std::uint32_t docs[block_size];
+        std::uint32_t freqs[block_size];
+        for (const auto t : expansion) {
+            const auto &entry = terms_[t];
+            const auto blocks = static_cast<std::uint32_t>((entry.doc_freq + block_size - 1U) / block_size);
+            for (std::uint32_t b = 0U; b < blocks; ++b) {
+                const auto count = decode_block(entry, b, docs, freqs);
+                for (std::size_t i = 0U; i < count; ++i) {
+                    sums[docs[i]] += freqs[i];
+                }
+            }
+        }
+        result.docs.reserve(std::min(total, sums.size()));
+        result.freqs.reserve(std::min(total, sums.size()));
+        collect_nonzero(sums.data(), sums.size(), result.docs, result.freqs);
+        return result;
+    }
+
+    std::vector<std::uint32_t> docs(total);
+    std::vector<std::uint32_t> freqs(total);
+    std::vector<posting_run> runs;
+    runs.reserve(expansion.size());
+    std::size_t filled = 0U;
+    for (const auto t : expansion) {
+        const auto &entry = terms_[t];
+        const auto blocks = static_cast<std::uint32_t>((entry.doc_freq + block_size - 1U) / block_size);
+        for (std::uint32_t b = 0U; b < blocks; ++b) {
+            decode_block(entry, b, docs.data() + filled + b * block_size, freqs.data() + filled + b * block_size);
+        }
+        runs.push_back(posting_run{docs.data() + filled, freqs.data() + filled, entry.doc_freq});
+        filled += entry.doc_freq;
+    }
+    merge_postings(runs, result.docs, result.freqs);
+    return result;
+}
+
+std::optional<std::vector<search_hit>> memory_index::search(const std::string &query,
+                                                            std::size_t limit,
+                                                            std::size_t offset,
+                                                            const std::vector<std::uint64_t> *allowed,
+                                                            const bm25_stats *corpus) const
+{
+    const auto terms = parse_query(query);
+    if (!terms.has_value()) {
+        return std::nullopt;
+    }
+    if (corpus != nullptr && corpus->phrase_docs.size() != terms->size()) {
+        throw std::runtime_error("bm25 statistics do not match the query");
+    }
+
+    const std::size_t wanted = limit + offset;
+    std::vector<phrase_cursor> cursors;
+    std::vector<double> idf;
+    cursors.reserve(terms->size());
+    const auto rows = static_cast<double>(corpus != nullptr ? corpus->rows : static_cast<std::int64_t>(docs_.size()));
+    const double average_length =
+        corpus != nullptr && corpus->rows > 0 ? static_cast<double>(corpus->tokens) / rows : average_length_;
+    // Block bounds were taken at this index's average length; a weight grows
+    // by at most the ratio of a longer one, so scaling keeps them bounds.
+    const double bound_scale = std::max(1.0, average_length / average_length_);
+    for (const auto &term : *terms) {
+        const auto [first, last] = term_range(term);
+        if (first == last || wanted == 0U) {
+            return std::vector<search_hit>{};
+        }
+        if (last - first == 1U) {
+            cursors.emplace_back(*this, terms_[first]);
+        }
+        else {
+            cursors.emplace_back(*this, collect_phrase(term));
+        }
+        const auto hits = static_cast<double>(corpus != nullptr ? corpus->phrase_docs[cursors.size() - 1U]
+                                                                : static_cast<std::int64_t>(cursors.back().size()));
+        const double value = std::log((rows - hits + 0.5) / (hits + 0.5));
+        idf.push_back(value <= 0.0 ? 1e-6 : value);
+    }
+
+    // The shortest list proposes candidates. Once the heap holds k docs, a
+    // candidate whose blocks' bounds sum to no more than the k-th score is
+    // skipped together with the rest of the smallest enclosing block, without
+    // decoding the other lists. Docs arrive in rowid order, so a later doc
+    // never wins a tie and the skip test may include equality.
+    std::vector<std::size_t> order(cursors.size());
+    for (std::size_t p = 0U; p < order.size(); ++p) {
+        order[p] = p;
+    }
+    std::stable_sort(order.begin(), order.end(), [&cursors](std::size_t lhs, std::size_t rhs) {
+        return cursors[lhs].size() < cursors[rhs].size();
+    });
+    auto &lead = cursors[order.front()];
+
+    std::vector<ranked_doc> top;
+    top.reserve(wanted + 1U);
+    std::uint32_t target = 0U;
+    while (true) {
+        const auto doc = lead.next_geq(target);
+        if (doc == phrase_cursor::end) {
+            break;
+        }
+        if (allowed != nullptr && !dense_contains(*allowed, static_cast<std::uint64_t>(docs_[doc].rowid))) {
+            target = doc + 1U;
+            continue;
+        }
+
+        if (top.size() == wanted) {
+            double bound = 0.0;
+            std::uint32_t block_last = phrase_cursor::end;
+            bool exhausted = false;
+            for (std::size_t p = 0U; p < cursors.size(); ++p) {
+                if (!cursors[p].shallow(doc)) {
+                    exhausted = true;
+                    break;
+                }
+                bound += idf[p] * cursors[p].block_bound() * bound_scale;
+                block_last = std::min(block_last, cursors[p].block_last());
+            }
+            if (exhausted) {
+                break;
+            }
+            if (-bound >= top.front().score) {
+                target = block_last + 1U;
+                continue;
+            }
+        }
+
+        std::uint32_t next = doc;
+        for (std::size_t i = 1U; i < order.size() && next == doc; ++i) {
+            next = cursors[order[i]].next_geq(doc);
+        }
+        if (next == phrase_cursor::end) {
+            break;
+        }
+        if (next != doc) {
+            target = next;
+            continue;
+        }
+
+        double score = 0.0;
+        for (std::size_t p = 0U; p < cursors.size(); ++p) {
+            score += idf[p] * weight(cursors[p].freq(), doc, average_length);
+        }
+        const ranked_doc candidate{-1.0 * score, doc};
+        if (top.size() < wanted) {
+            top.push_back(candidate);
+            std::push_heap(top.begin(), top.end(), ranks_before);
+        }
+        else if (ranks_before(candidate, top.front())) {
+            std::pop_heap(top.begin(), top.end(), ranks_before);
+            top.back() = candidate;
+            std::push_heap(top.begin(), top.end(), ranks_before);
+        }
+        target = doc + 1U;
+    }
+    std::sort_heap(top.begin(), top.end(), ranks_before);
+
+    std::vector<search_hit> hits;
+    for (std::size_t i = offset; i < top.size(); ++i) {
+        const auto &entry = docs_[top[i].doc];
+        const auto doc = read_doc(entry);
+        search_hit hit;
+        hit.url = doc.url;
+        hit.title = doc.title;
+        hit.format = doc.format;
+        hit.tags_json = doc.tags_json;
+        hit.lang = doc.lang;
+        hit.updated_at = entry.updated_at;
+        hit.score = top[i].score;
+        hit.snippet = make_snippet(doc.body_blob, *terms);
+        hits.push_back(std::move(hit));
+    }
+    return hits;
+}
+
+std::optional<bm25_stats> memory_index::query_stats(const std::string &query) const
+{
+    const auto terms = parse_query(query);
+    if (!terms.has_value()) {
+        return std::nullopt;
+    }
+    bm25_stats stats;
+    stats.rows = static_cast<std::int64_t>(docs_.size());
+    stats.tokens = static_cast<std::int64_t>(total_tokens_);
+    for (const auto &term : *terms) {
+        const auto [first, last] = term_range(term);
+        std::size_t docs = 0U;
+        if (last - first == 1U) {
+            docs = terms_[first].doc_freq;
+        }
+        else if (first != last) {
+            docs = collect_phrase(term).docs.size();
+        }
+        stats.phrase_docs.push_back(static_cast<std::int64_t>(docs));
+    }
+    return stats;
+}
+
+bool memory_index::supports(const std::string &query) const
+{
+    return parse_query(query).has_value();
+}
+
+std::optional<std::vector<std::uint64_t>> memory_index::match_set(const std::string &query,
+                                                                  const std::vector<std::uint64_t> *allowed) const
+{
+    const auto terms = parse_query(query);
+    if (!terms.has_value()) {
+        return std::nullopt;
+    }
+
+    // Facet sets need every match rather than the top k, so phrases are
+    // intersected smallest first over whole doc lists. A term many times
+    // longer than what is left is probed with a cursor instead, which skips
+    // the blocks in between without decoding them.
+    struct phrase_list
+    {
+        const term_entry *term = nullptr;
+        std::vector<std::uint32_t> docs;
+        std::size_t size = 0U;
+    };
+    std::vector<phrase_list> lists;
+    lists.reserve(terms->size());
+    for (const auto &term : *terms) {
+        const auto [first, last] = term_range(term);
+        if (first == last) {
+            return std::vector<std::uint64_t>{};
+        }
+        if (last - first == 1U) {
+            lists.push_back(phrase_list{&terms_[first], {}, terms_[first].doc_freq});
+        }
+        else {
+            auto docs = collect_phrase(term).docs;
+            const auto size = docs.size();
+            lists.push_back(phrase_list{nullptr, std::move(docs), size});
+        }
+    }
+    std::stable_sort(lists.begin(), lists.end(), [](const phrase_list &lhs, const phrase_list &rhs) {
+        return lhs.size < rhs.size;
+    });
+
+    auto matched = lists.front().term != nullptr ? term_docs(*lists.front().term) : std::move(lists.front().docs);
+    std::vector<std::uint32_t> scratch;
+    for (std::size_t i = 1U; i < lists.size() && !matched.empty(); ++i) {
+        auto &list = lists[i];
+        std::size_t count = 0U;
+        scratch.resize(matched.size());
+        if (list.term != nullptr && list.size / matched.size() >= block_size) {
+            phrase_cursor cursor{*this, *list.term};
+            for (const auto doc : matched) {
+                const auto next = cursor.next_geq(doc);
+                if (next == phrase_cursor::end) {
+                    break;
+                }
+                scratch[count] = doc;
+                count += next == doc ? 1U : 0U;
+            }
+        }
+        else {
+            if (list.term != nullptr) {
+                list.docs = term_docs(*list.term);
+            }
+            count = intersect_sorted(matched.data(), matched.size(), list.docs.data(), list.docs.size(), scratch.data());
+        }
+        scratch.resize(count);
+        matched.swap(scratch);
+    }
+
+    std::vector<std::uint64_t> set;
+    for (const auto doc : matched) {
+        const auto rowid = static_cast<std::uint64_t>(docs_[doc].rowid);
+        if (allowed == nullptr || dense_contains(*allowed, rowid)) {
+            dense_insert(set, rowid);
+        }
+    }
+    return set;
+}
+
+// Mirrors FTS5 snippet(docs_fts, 1, '<mark>', '</mark>', '...', 24): pick
+// the 24-token window with the best instance score (sentence starts get a
+// bonus), then highlight every matching token inside it.
+std::string memory_index::make_snippet(std::string_view body_blob, const std::vector<query_term> &terms) const
+{
+    const auto text = inflate_text(body_blob);
+    const auto tokens = tokenizer_.tokenize(text, FTS5_TOKENIZE_DOCUMENT);
+    const int size = static_cast<int>(tokens.size());
+
+    struct instance
+    {
+        int phrase = 0;
+        int position = 0;
+    };
+    std::vector<instance> instances;
+    std::vector<int> sentences;
+    for (int pos = 0; pos < size; ++pos) {
+        for (std::size_t p = 0U; p < terms.size(); ++p) {
+            if (matches(tokens[pos].text, terms[p].text, terms[p].prefix)) {
+                instances.push_back(instance{static_cast<int>(p), pos});
+            }
+        }
+        if (pos == 0) {
+            sentences.push_back(0);
+            continue;
+        }
+        int i = tokens[pos].start - 1;
+        char ch = 0;
+        for (; i >= 0; --i) {
+            ch = text[static_cast<std::size_t>(i)];
+            if (ch != ' ' && ch != '\t' && ch != '\n' && ch != '\r') {
+                break;
+            }
+        }
+        if (i != tokens[pos].start - 1 && (ch == '.' || ch == ':')) {
+            sentences.push_back(pos);
+        }
+    }
+
+    std::vector<unsigned char> seen(terms.size());
+    const auto window_score = [&](int start, int *adjusted) {
+        std::fill(seen.begin(), seen.end(), 0U);
+        int score = 0;
+        int first = -1;
+        int last = 0;
+        for (const auto &inst : instances) {
+            if (inst.position < start || inst.position >= start + snippet_tokens) {
+                continue;
+            }
+            score += seen[inst.phrase] != 0U ? 1 : 1000;
+            seen[inst.phrase] = 1U;
+            if (first < 0) {
+                first = inst.position;
+            }
+            last = inst.position + 1;
+        }
+        if (adjusted != nullptr) {
+            int adjust = first - (snippet_tokens - (last - first)) / 2;
+            if (adjust + snippet_tokens > size) {
+                adjust = size - snippet_tokens;
+            }
+            *adjusted = std::max(adjust, 0);
+        }
+        return score;
+    };
+
+    int best_score = 0;
+    int best_start = 0;
+    for (const auto &inst : instances) {
+        int adjusted = 0;
+        int score = window_score(inst.position, &adjusted);
+        if (score > best_score) {
+            best_score = score;
+            best_start = adjusted;
+        }
+        if (size > snippet_tokens) {
+            std::size_t s = 0U;
+            while (s + 1U < sentences.size() && sentences[s + 1U] <= inst.position) {
+                ++s;
+            }
+            if (sentences[s] < inst.position) {
+                score = window_score(sentences[s], nullptr) + (sentences[s] == 0 ? 120 : 100);
+                if (score > best_score) {
+                    best_score = score;
+                    best_start = sentences[s];
+                }
+            }
+        }
+    }
+
+    std::vector<int> marks;
+    for (const auto &inst : instances) {
+        if (inst.position >= best_start && (marks.empty() || marks.back() != inst.position)) {
+            marks.push_back(inst.position);
+        }
+    }
+
+    const int range_end = best_start + snippet_tokens - 1;
+    std::string snippet;
+    if (best_start > 0) {
+        snippet += "...";
+    }
+    std::size_t copied = 0U;
+    std::size_t mark = 0U;
+    for (int pos = best_start; pos < size && pos <= range_end; ++pos) {
+        const auto start = static_cast<std::size_t>(tokens[pos].start);
+        const auto end = static_cast<std::size_t>(tokens[pos].end);
+        if (best_start > 0 && pos == best_start) {
+            copied = start;
+        }
+        if (mark < marks.size() && marks[mark] == pos) {
+            snippet.append(text, copied, start - copied).append("<mark>");
+            snippet.append(text, start, end - start).append("</mark>");
+            copied = end;
+            ++mark;
+        }
+        if (pos == range_end) {
+            snippet.append(text, copied, end - copied);
+            copied = end;
+        }
+    }
+    if (range_end >= size - 1) {
+        snippet.append(text, copied);
+    }
+    else {
+        snippet += "...";
+    }
+    return snippet;
+}
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "index/fts5_tokenizer.h"
+#include "index/segment_file.h"
+#include "index/sqlite_database.h"
+#include "search/query_service.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace retort
+{
+// Serializes a schema v2 index into a segment image (index/segment_format.h)
+// by running every document through the docs_fts tokenizer. Terms are kept in
+// one sorted dictionary; each posting list is split into blocks of
+// delta+varint coded (doc, title tf, body tf) triples, and each block
+// records an upper bound of the bm25 term weight of its postings so top-k
+// evaluation can skip blocks that cannot reach the current k-th score.
+// With prefix_fanout set in meta, a byte trie maps every prefix that expands
+// to more terms than that to its prefix_fanout most frequent expansions.
+std::vector<std::uint8_t> build_segment(sqlite_database &database);
+
+// Inverted index served straight from a segment image: either built in
+// memory from a SQLite index at startup, or a segment file mapped as is.
+// Scores and snippets follow FTS5's bm25() and snippet() so results match
+// the SQL path.
+class memory_index
+{
+public:
+    explicit memory_index(sqlite_database &database);
+    explicit memory_index(const std::filesystem::path &segment_path);
+
+    // nullopt when the query uses syntax this engine does not evaluate
+    // (operators, quoted phrases, columns, multi-token barewords); the caller
+    // falls back to FTS5 for those. With allowed set, only docs whose rowid
+    // is in that dense bitset are ranked. With corpus set, idf and the
+    // average length come from it instead of this index.
+    std::optional<std::vector<search_hit>> search(const std::string &query,
+                                                  std::size_t limit,
+                                                  std::size_t offset,
+                                                  const std::vector<std::uint64_t> *allowed = nullptr,
+                                                  const bm25_stats *corpus = nullptr) const;
+
+    // This index's rows, tokens and per-term document counts for query;
+    // nullopt like search().
+    std::optional<bm25_stats> query_stats(const std::string &query) const;
+
+    // Rowids of every doc matching query, as a dense bitset; nullopt like
+    // search().
+    std::optional<std::vector<std::uint64_t>> match_set(const std::string &query,
+                                                        const std::vector<std::uint64_t> *allowed = nullptr) const;
+
+    // Whether search() and match_set() evaluate query rather than return
+    // nullopt.
+    bool supports(const std::string &query) const;
+
+    std::size_t doc_count() const noexcept;
+
+    meta_info load_meta() const;
+
+private:
+    using term_entry = segment_term;
+
+    struct stored_doc
+    {
+        std::string_view url;
+        std::string_view title;
+        std::string_view format;
+        std::string_view tags_json;
+        std::string_view lang;
+        std::string_view body_blob;
+    };
+
+    struct query_term
+    {
+        std::string text;
+        bool prefix = false;
+    };
+
+    struct phrase_postings
+    {
+        std::vector<std::uint32_t> docs;
+        std::vector<std::uint32_t> freqs;
+    };
+
+    class phrase_cursor;
+
+    void attach();
+    stored_doc read_doc(const segment_doc &doc) const;
+    std::string_view term_text(const term_entry &term) const;
+    double weight(std::uint32_t freq, std::uint32_t doc, double average_length) const;
+    std::optional<std::vector<query_term>> parse_query(const std::string &query) const;
+    std::pair<std::size_t, std::size_t> term_range(const query_term &term) const;
+    std::span<const std::uint32_t> top_expansions(std::string_view prefix) const;
+    std::size_t decode_block(const term_entry &term, std::uint32_t block, std::uint32_t *docs, std::uint32_t *freqs) const;
+    std::vector<std::uint32_t> term_docs(const term_entry &term) const;
+    phrase_postings collect_phrase(const query_term &term) const;
+    std::string make_snippet(std::string_view body_blob, const std::vector<query_term> &terms) const;
+
+    std::vector<std::uint8_t> image_;
+    mapped_file mapping_;
+    segment_view segment_;
+    std::unique_ptr<sqlite_database> tokenizer_database_;
+    fts5_tokenizer_handle tokenizer_;
+    std::span<const segment_doc> docs_;
+    std::string_view doc_strings_;
+    std::span<const std::uint32_t> lengths_;
+    std::span<const term_entry> terms_;
+    std::string_view term_text_;
+    std::span<const segment_block> blocks_;
+    std::span<const std::uint8_t> postings_;
+    std::span<const segment_prefix_node> prefix_nodes_;
+    std::span<const std::uint32_t> prefix_terms_;
+    std::size_t prefix_fanout_ = 0U;
+    std::uint64_t total_tokens_ = 0U;
+    double average_length_ = 0.0;
+};
+}
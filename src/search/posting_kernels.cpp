@@ -0,0 +1,291 @@
+#include "posting_kernels.h"
+
+#include <algorithm>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define RETORT_KERNELS_X86 1
+#endif
+
+namespace retort
+{
+namespace
+{
+constexpr std::size_t galloping_ratio = 128U;
+
+std::size_t intersect_scalar(const std::uint32_t *a, std::size_t a_size,
+                             const std::uint32_t *b, std::size_t b_size,
+                             std::uint32_t *out) {
+    std::size_t i = 0U;
+    std::size_t j = 0U;
+    std::size_t count = 0U;
+    while (i < a_size && j < b_size) {
+        const auto x = a[i];
+        const auto y = b[j];
+        out[count] = x;
+        count += x == y ? 1U : 0U;
+        i += x <= y ? 1U : 0U;
+        j += y <= x ? 1U : 0U;
+    }
+    return count;
+}
+
+#if defined(RETORT_KERNELS_X86)
+// Each step compares a block of a against every rotation of a block of b,
+// emits the matching lanes of a, then advances whichever block ends lower.
+__attribute__((target("sse4.2"))) std::size_t intersect_sse42(const std::uint32_t *a, std::size_t a_size,
+                                                              const std::uint32_t *b, std::size_t b_size,
+                                                              std::uint32_t *out) {
+    std::size_t i = 0U;
+    std::size_t j = 0U;
+    std::size_t count = 0U;
+    while (i + 4U <= a_size && j + 4U <= b_size) {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + j));
+        __m128i hits = _mm_cmpeq_epi32(va, vb);
+        for (int r = 1; r < 4; ++r) {
+            vb = _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1));
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi32(va, vb));
+        }
+        auto mask = static_cast<unsigned int>(_mm_movemask_ps(_mm_castsi128_ps(hits)));
+        while (mask != 0U) {
+            out[count++] = a[i + static_cast<std::size_t>(__builtin_ctz(mask))];
+            mask &= mask - 1U;
+        }
+        const auto a_last = a[i + 3U];
+        const auto b_last = b[j + 3U];
+        i += a_last <= b_last ? 4U : 0U;
+        j += b_last <= a_last ? 4U : 0U;
+    }
+    return count + intersect_scalar(a + i, a_size - i, b + j, b_size - j, out + count);
+}
+
+__attribute__((target("avx2"))) std::size_t intersect_avx2(const std::uint32_t *a, std::size_t a_size,
+                                                           const std::uint32_t *b, std::size_t b_size,
+                                                           std::uint32_t *out) {
+    const __m256i rotate = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+    std::size_t i = 0U;
+    std::size_t j = 0U;
+    std::size_t count = 0U;
+    while (i + 8U <= a_size && j + 8U <= b_size) {
+        const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + j));
+        __m256i hits = _mm256_cmpeq_epi32(va, vb);
+        for (int r = 1; r < 8; ++r) {
+            vb = _mm256_permutevar8x32_epi32(vb, rotate);
+            hits = _mm256_or_si256(hits, _mm256_cmpeq_epi32(va, vb));
+        }
+        auto mask = static_cast<unsigned int>(_mm256_movemask_ps(_mm256_castsi256_ps(hits)));
+        while (mask != 0U) {
+            out[count++] = a[i + static_cast<std::size_t>(__builtin_ctz(mask))];
+            mask &= mask - 1U;
+        }
+        const auto a_last = a[i + 7U];
+        const auto b_last = b[j + 7U];
+        i += a_last <= b_last ? 8U : 0U;
+        j += b_last <= a_last ? 8U : 0U;
+    }
+    return count + intersect_scalar(a + i, a_size - i, b + j, b_size - j, out + count);
+}
+
+__attribute__((target("avx2"))) std::size_t skip_zero_avx2(const std::uint32_t *counters, std::size_t begin, std::size_t size) {
+    while (begin + 8U <= size) {
+        const __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(counters + begin));
+        if (_mm256_testz_si256(values, values) == 0) {
+            break;
+        }
+        begin += 8U;
+    }
+    return begin;
+}
+
+bool os_saves_ymm() {
+    unsigned int low = 0U;
+    unsigned int high = 0U;
+    __asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0U));
+    return (low & 0x6U) == 0x6U;
+}
+
+intersect_kernel detect_kernel() {
+    unsigned int eax = 0U;
+    unsigned int ebx = 0U;
+    unsigned int ecx = 0U;
+    unsigned int edx = 0U;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0) {
+        return intersect_kernel::scalar;
+    }
+    const bool has_sse42 = (ecx & (1U << 20)) != 0U;
+    const bool has_avx = (ecx & (1U << 27)) != 0U && (ecx & (1U << 28)) != 0U && os_saves_ymm();
+    bool has_avx2 = false;
+    if (has_avx && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) != 0) {
+        has_avx2 = (ebx & (1U << 5)) != 0U;
+    }
+    if (has_avx2) {
+        return intersect_kernel::avx2;
+    }
+    return has_sse42 ? intersect_kernel::sse42 : intersect_kernel::scalar;
+}
+#else
+intersect_kernel detect_kernel() {
+    return intersect_kernel::scalar;
+}
+#endif
+
+const intersect_kernel detected_kernel = detect_kernel();
+}
+
+intersect_kernel best_intersect_kernel() noexcept
+{
+    return detected_kernel;
+}
+
+const char *kernel_name(intersect_kernel kernel) noexcept
+{
+    switch (kernel) {
+    case intersect_kernel::avx2:
+        return "avx2";
+    case intersect_kernel::sse42:
+        return "sse4.2";
+    default:
+        return "scalar";
+    }
+}
+
+std::size_t intersect_merge(intersect_kernel kernel,
+                            const std::uint32_t *a, std::size_t a_size,
+                            const std::uint32_t *b, std::size_t b_size,
+                            std::uint32_t *out) {
+#if defined(RETORT_KERNELS_X86)
+    if (kernel == intersect_kernel::avx2 && detected_kernel == intersect_kernel::avx2) {
+        return intersect_avx2(a, a_size, b, b_size, out);
+    }
+    if (kernel != intersect_kernel::scalar && detected_kernel != intersect_kernel::scalar) {
+        return intersect_sse42(a, a_size, b, b_size, out);
+    }
+#endif
+    (void)kernel;
+    return intersect_scalar(a, a_size, b, b_size, out);
+}
+
+std::size_t intersect_galloping(const std::uint32_t *small, std::size_t small_size,
+                                const std::uint32_t *large, std::size_t large_size,
+                                std::uint32_t *out) {
+    std::size_t count = 0U;
+    std::size_t low = 0U;
+    for (std::size_t i = 0U; i < small_size && low < large_size; ++i) {
+        const auto target = small[i];
+        std::size_t step = 1U;
+        std::size_t high = low;
+        while (high < large_size && large[high] < target) {
+            low = high + 1U;
+            high += step;
+            step <<= 1U;
+        }
+        high = std::min(high + 1U, large_size);
+        low = static_cast<std::size_t>(std::lower_bound(large + low, large + high, target) - large);
+        if (low < large_size && large[low] == target) {
+            out[count++] = target;
+            ++low;
+        }
+    }
+    return count;
+}
+
+std::size_t intersect_sorted(const std::uint32_t *a, std::size_t a_size,
+                             const std::uint32_t *b, std::size_t b_size,
+                             std::uint32_t *out) {
+    if (a_size > b_size) {
+        std::swap(a, b);
+        std::swap(a_size, b_size);
+    }
+    if (a_size == 0U) {
+        return 0U;
+    }
+    if (b_size / a_size >= galloping_ratio) {
+        return intersect_galloping(a, a_size, b, b_size, out);
+    }
+    return intersect_merge(detected_kernel, a, a_size, b, b_size, out);
+}
+
+void merge_postings(std::span<const posting_run> runs,
+                    std::vector<std::uint32_t> &docs,
+                    std::vector<std::uint32_t> &freqs) {
+    docs.clear();
+    freqs.clear();
+    if (runs.empty()) {
+        return;
+    }
+    if (runs.size() == 1U) {
+        docs.assign(runs[0].docs, runs[0].docs + runs[0].size);
+        freqs.assign(runs[0].freqs, runs[0].freqs + runs[0].size);
+        return;
+    }
+
+    // Merge adjacent pairs level by level: log2(k) sequential passes beat a
+    // heap once k grows past a handful of runs.
+    std::vector<posting_run> level{runs.begin(), runs.end()};
+    std::vector<std::vector<std::uint32_t>> level_docs;
+    std::vector<std::vector<std::uint32_t>> level_freqs;
+    while (level.size() > 1U) {
+        std::vector<posting_run> next;
+        std::vector<std::vector<std::uint32_t>> next_docs;
+        std::vector<std::vector<std::uint32_t>> next_freqs;
+        for (std::size_t r = 0U; r < level.size(); r += 2U) {
+            const auto &left = level[r];
+            const auto right = r + 1U < level.size() ? level[r + 1U] : posting_run{};
+            auto &out_docs = next_docs.emplace_back(left.size + right.size);
+            auto &out_freqs = next_freqs.emplace_back(left.size + right.size);
+            std::size_t i = 0U;
+            std::size_t j = 0U;
+            std::size_t n = 0U;
+            while (i < left.size && j < right.size) {
+                const auto x = left.docs[i];
+                const auto y = right.docs[j];
+                out_docs[n] = x <= y ? x : y;
+                out_freqs[n] = (x <= y ? left.freqs[i] : 0U) + (y <= x ? right.freqs[j] : 0U);
+                ++n;
+                i += x <= y ? 1U : 0U;
+                j += y <= x ? 1U : 0U;
+            }
+            for (; i < left.size; ++i, ++n) {
+                out_docs[n] = left.docs[i];
+                out_freqs[n] = left.freqs[i];
+            }
+            for (; j < right.size; ++j, ++n) {
+                out_docs[n] = right.docs[j];
+                out_freqs[n] = right.freqs[j];
+            }
+            out_docs.resize(n);
+            out_freqs.resize(n);
+            next.push_back(posting_run{out_docs.data(), out_freqs.data(), n});
+        }
+        level = std::move(next);
+        level_docs = std::move(next_docs);
+        level_freqs = std::move(next_freqs);
+    }
+    docs = std::move(level_docs.front());
+    freqs = std::move(level_freqs.front());
+}
+
+void collect_nonzero(const std::uint32_t *counters, std::size_t size,
+                     std::vector<std::uint32_t> &docs,
+                     std::vector<std::uint32_t> &freqs) {
+    std::size_t i = 0U;
+    while (i < size) {
+#if defined(RETORT_KERNELS_X86)
+        if (detected_kernel == intersect_kernel::avx2) {
+            i = skip_zero_avx2(counters, i, size);
+        }
+#endif
+        const auto end = std::min(size, i + 8U);
+        for (; i < end; ++i) {
+            if (counters[i] != 0U) {
+                docs.push_back(static_cast<std::uint32_t>(i));
+                freqs.push_back(counters[i]);
+            }
+        }
+    }
+}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace retort
+{
+// Kernels over sorted, duplicate-free doc-id arrays. Output buffers must not
+// alias the inputs and need room for the smaller input.
+enum class intersect_kernel
+{
+    scalar,
+    sse42,
+    avx2
+};
+
+// The widest kernel the CPU supports, detected once via CPUID.
+intersect_kernel best_intersect_kernel() noexcept;
+const char *kernel_name(intersect_kernel kernel) noexcept;
+
+// Block-wise merge intersection: compares 4 (SSE4.2) or 8 (AVX2) ids from
+// each list against each other per step.
+std::size_t intersect_merge(intersect_kernel kernel,
+                            const std::uint32_t *a, std::size_t a_size,
+                            const std::uint32_t *b, std::size_t b_size,
+                            std::uint32_t *out);
+
+// Exponential then binary search of each id of the short list in the long
+// one; wins once the lengths differ by more than about 128x.
+std::size_t intersect_galloping(const std::uint32_t *small, std::size_t small_size,
+                                const std::uint32_t *large, std::size_t large_size,
+                                std::uint32_t *out);
+
+// Picks galloping or the best merge kernel from the length ratio.
+std::size_t intersect_sorted(const std::uint32_t *a, std::size_t a_size,
+                             const std::uint32_t *b, std::size_t b_size,
+                             std::uint32_t *out);
+
+struct posting_run
+{
+    const std::uint32_t *docs = nullptr;
+    const std::uint32_t *freqs = nullptr;
+    std::size_t size = 0U;
+};
+
+// k-way merge of prefix expansions into one list, adding the frequencies of
+// a doc that appears in several runs. Runs are merged pairwise in log2(k)
+// passes.
+void merge_postings(std::span<const posting_run> runs,
+                    std::vector<std::uint32_t> &docs,
+                    std::vector<std::uint32_t> &freqs);
+
+// Appends the index and value of every non-zero counter, in index order.
+void collect_nonzero(const std::uint32_t *counters, std::size_t size,
+                     std::vector<std::uint32_t> &docs,
+                     std::vector<std::uint32_t> &freqs);
+}
@@ -1,6 +1,18 @@
 #include "query_service.h"
 
+#include "index/global_bm25.h"
+#include "index/schema_migration.h"
+#include "search/memory_index.h"
+#include "util/json.h"
+#include "util/text_normalizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <sstream>
 #include <stdexcept>
+#include <string>
 #include <utility>
 
 namespace retort
@@ -12,31 +24,271 @@ void check_sqlite(int code) {
         throw std::runtime_error("sqlite operation failed");
     }
 }
+
+int read_schema_version(sqlite3 *db) {
+    sqlite3_stmt *stmt = nullptr;
+    const char *sql = "SELECT value FROM meta WHERE key = 'schema_version'";
+    check_sqlite(sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr));
+    int version = 1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        const auto *text = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+        version = text != nullptr ? std::atoi(text) : 1;
+    }
+    sqlite3_finalize(stmt);
+    return version;
+}
+
+bool has_table(sqlite3 *db, const char *name) {
+    sqlite3_stmt *stmt = nullptr;
+    check_sqlite(sqlite3_prepare_v2(db, "SELECT 1 FROM sqlite_master WHERE name = ?", -1, &stmt, nullptr));
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    const bool found = sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+std::string quote_phrase(const std::string &text) {
+    std::string quoted{"\""};
+    for (const char ch : text) {
+        quoted.push_back(ch);
+        if (ch == '"') {
+            quoted.push_back('"');
+        }
+    }
+    quoted.push_back('"');
+    return quoted;
+}
+
+std::string match_expression(const std::string &query, match_mode mode) {
+    if (mode != match_mode::substring) {
+        return query;
+    }
+    auto match = quote_phrase(query);
+    // Titles are stored as written, bodies in normalized form.
+    const auto body = normalize_text(query);
+    if (body != query && !body.empty()) {
+        match += " OR " + quote_phrase(body);
+    }
+    return match;
+}
+
+std::string fts_table(match_mode mode) {
+    return mode == match_mode::substring ? "docs_fts_tri" : mode == match_mode::titles ? "docs_fts_title" : "docs_fts";
+}
+
+// retort_bm25's arguments after the table, as SQL literals so they can also
+// go into a rank MATCH string.
+std::string corpus_arguments(const bm25_stats &corpus) {
+    std::string arguments = std::to_string(corpus.rows) + ", " + std::to_string(corpus.tokens) + ", " +
+                            std::to_string(corpus.phrase_docs.size());
+    for (const auto docs : corpus.phrase_docs) {
+        arguments += ", " + std::to_string(docs);
+    }
+    return arguments;
+}
+
+constexpr double seconds_per_day = 86400.0;
+
+// Decay relative to the newest document, so that a query only has to scale
+// the whole vector by the newest one's decay at the current time.
+std::vector<float> read_recency(sqlite3 *db, double half_life_days, std::int64_t &newest) {
+    sqlite3_stmt *stmt = nullptr;
+    check_sqlite(sqlite3_prepare_v2(db, "SELECT max(id), max(updated_at) FROM docs", -1, &stmt, nullptr));
+    std::int64_t last_id = 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        last_id = sqlite3_column_int64(stmt, 0);
+        newest = sqlite3_column_int64(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+
+    std::vector<float> recency(static_cast<std::size_t>(std::max<std::int64_t>(last_id, 0)) + 1U, 1.0F);
+    const double half_life = half_life_days * seconds_per_day;
+    check_sqlite(sqlite3_prepare_v2(db, "SELECT id, updated_at FROM docs", -1, &stmt, nullptr));
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const auto id = sqlite3_column_int64(stmt, 0);
+        const auto age = static_cast<double>(newest - sqlite3_column_int64(stmt, 1));
+        if (id >= 0) {
+            recency[static_cast<std::size_t>(id)] = static_cast<float>(std::exp2(-age / half_life));
+        }
+    }
+    sqlite3_finalize(stmt);
+    return recency;
+}
+
+// Indexes written before hot prefixes existed have no such table.
+std::unordered_map<std::string, std::vector<std::string>> read_hot_hits(sqlite3 *db) {
+    std::unordered_map<std::string, std::vector<std::string>> hot;
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, "SELECT prefix, hit FROM hot_prefixes ORDER BY prefix, rank", -1, &stmt, nullptr) != SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        return hot;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const auto *prefix = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+        const auto *hit = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+        hot[prefix].emplace_back(hit);
+    }
+    sqlite3_finalize(stmt);
+    return hot;
+}
+}
+
+std::string to_json(const search_hit &hit) {
+    std::ostringstream oss;
+    oss << '{'
+        << "\"url\":\"" << json_escape(hit.url) << '\"'
+        << ",\"title\":\"" << json_escape(hit.title) << '\"'
+        << ",\"format\":\"" << json_escape(hit.format) << '\"'
+        << ",\"tags\":" << hit.tags_json
+        << ",\"lang\":\"" << json_escape(hit.lang) << '\"'
+        << ",\"updated_at\":" << hit.updated_at
+        << ",\"score\":" << hit.score
+        << ",\"snippet\":\"" << json_escape(hit.snippet) << '\"'
+        << '}';
+    return oss.str();
+}
+
+query_service::query_service(sqlite_database &database, search_engine engine, const ranking_config &ranking)
+    : database_{&database},
+      schema_version_{read_schema_version(database.handle())},
+      ranking_{ranking}
+{
+    if (schema_version_ < 1 || schema_version_ > current_schema_version) {
+        throw std::runtime_error("unsupported index schema version: " + std::to_string(schema_version_));
+    }
+    if (engine == search_engine::memory) {
+        if (schema_version_ < 2) {
+            throw std::runtime_error("memory engine requires schema version 2");
+        }
+        memory_ = std::make_unique<memory_index>(database);
+    }
+    if (!ranking_.is_default()) {
+        if (schema_version_ < 2) {
+            throw std::runtime_error("custom ranking requires schema version 2");
+        }
+        if (ranking_.recency_boost > 0.0) {
+            recency_ = read_recency(database.handle(), ranking_.recency_half_life_days, newest_update_);
+        }
+    }
+    else {
+        // Stored hits carry FTS5's order, which custom ranking would contradict.
+        hot_hits_ = read_hot_hits(database.handle());
+    }
+    dictionary_ = term_dictionary{database.handle()};
+    spelling_ = spelling_index{database.handle()};
+    completions_ = completion_index{database.handle()};
+    facets_ = facet_index{database.handle()};
+    title_index_ = has_table(database.handle(), "docs_fts_title");
 }
 
-query_service::query_service(sqlite_database &database)
-    : database_{database}
+query_service::query_service(std::unique_ptr<memory_index> segment)
+    : schema_version_{current_schema_version},
+      memory_{std::move(segment)}
 {
 }
 
+query_service::~query_service() = default;
+
 std::vector<search_hit> query_service::search(const std::string &query,
                                               std::size_t limit,
-                                              std::size_t offset) const
+                                              std::size_t offset,
+                                              match_mode mode,
+                                              const search_filter &filter,
+                                              const bm25_stats *corpus) const
 {
-    sqlite3_stmt *stmt = nullptr;
-    const char *sql =
+    if (mode == match_mode::substring && database_ == nullptr) {
+        throw std::runtime_error("substring search is not supported by segment indexes");
+    }
+    if (mode == match_mode::titles && !title_index_) {
+        throw std::runtime_error("title search is not available for this index");
+    }
+    std::vector<std::uint64_t> allowed;
+    if (!filter.empty()) {
+        if (facets_.empty()) {
+            throw std::runtime_error("filters are not available for this index");
+        }
+        allowed = facets_.resolve(filter);
+        if (allowed.empty()) {
+            return {};
+        }
+    }
+    if (memory_ && mode == match_mode::words) {
+        auto hits = memory_->search(query, limit, offset, filter.empty() ? nullptr : &allowed, corpus);
+        if (hits.has_value()) {
+            return std::move(*hits);
+        }
+        if (database_ == nullptr) {
+            throw std::runtime_error("query syntax is not supported by segment indexes");
+        }
+    }
+    if (!ranking_.is_default()) {
+        return search_ranked(query, limit, offset, mode, filter.empty() ? nullptr : &allowed, corpus);
+    }
+
+    // v2 lets FTS5 consume ORDER BY rank, so snippet() only inflates the
+    // bodies of rows that are actually returned. A filter is tested on each
+    // FTS5 row before the docs join, against the bitset bound to ?4.
+    const auto allowed_on = [&filter](const char *rowid) {
+        return filter.empty() ? std::string{} : std::string{" AND retort_allowed(?4, "} + rowid + ")";
+    };
+    // With corpus statistics, rank is retort_bm25() over them rather than
+    // this file's bm25(), and FTS5 still consumes ORDER BY rank.
+    const auto ranked_by = [corpus](const char *table) {
+        return corpus == nullptr ? std::string{}
+                                 : std::string{" AND "} + table + ".rank MATCH '" + global_bm25_name + "(" +
+                                       corpus_arguments(*corpus) + ")'";
+    };
+    const std::string sql_v1 =
         "SELECT v.url, v.title, v.format, v.tags, v.lang, v.updated_at,"
-        " bm25(docs_fts) AS score,"
+        " docs_fts.rank AS score,"
         " snippet(docs_fts, 2, '<mark>', '</mark>', '...', 24) AS snippet"
         " FROM docs_fts"
         " JOIN v_search v ON v.doc_id = docs_fts.doc_id"
-        " WHERE docs_fts MATCH ?"
+        " WHERE docs_fts MATCH ?1" + ranked_by("docs_fts") + allowed_on("v.id") +
         " ORDER BY score"
-        " LIMIT ? OFFSET ?";
-    check_sqlite(sqlite3_prepare_v2(database_.handle(), sql, -1, &stmt, nullptr));
-    sqlite3_bind_text(stmt, 1, query.c_str(), -1, SQLITE_TRANSIENT);
+        " LIMIT ?2 OFFSET ?3";
+    const std::string sql_v2 =
+        "SELECT d.url, d.title, d.format, d.tags, d.lang, d.updated_at,"
+        " docs_fts.rank AS score,"
+        " snippet(docs_fts, 1, '<mark>', '</mark>', '...', 24) AS snippet"
+        " FROM docs_fts"
+        " JOIN docs d ON d.id = docs_fts.rowid"
+        " WHERE docs_fts MATCH ?1" + ranked_by("docs_fts") + allowed_on("docs_fts.rowid") +
+        " ORDER BY docs_fts.rank"
+        " LIMIT ?2 OFFSET ?3";
+    // A trigram phrase matches its text as a substring, and unlike LIKE it
+    // still ranks with bm25 and highlights with snippet().
+    const std::string sql_substring =
+        "SELECT d.url, d.title, d.format, d.tags, d.lang, d.updated_at,"
+        " docs_fts_tri.rank AS score,"
+        " snippet(docs_fts_tri, 1, '<mark>', '</mark>', '...', 24) AS snippet"
+        " FROM docs_fts_tri"
+        " JOIN docs d ON d.id = docs_fts_tri.rowid"
+        " WHERE docs_fts_tri MATCH ?1" + ranked_by("docs_fts_tri") + allowed_on("docs_fts_tri.rowid") +
+        " ORDER BY docs_fts_tri.rank"
+        " LIMIT ?2 OFFSET ?3";
+    const std::string sql_titles =
+        "SELECT d.url, d.title, d.format, d.tags, d.lang, d.updated_at,"
+        " docs_fts_title.rank AS score,"
+        " snippet(docs_fts_title, 0, '<mark>', '</mark>', '...', 24) AS snippet"
+        " FROM docs_fts_title"
+        " JOIN docs d ON d.id = docs_fts_title.rowid"
+        " WHERE docs_fts_title MATCH ?1" + ranked_by("docs_fts_title") + allowed_on("docs_fts_title.rowid") +
+        " ORDER BY docs_fts_title.rank"
+        " LIMIT ?2 OFFSET ?3";
+    const auto &sql = mode == match_mode::substring ? sql_substring
+                      : mode == match_mode::titles  ? sql_titles
+                      : schema_version_ >= 2        ? sql_v2
+                                                    : sql_v1;
+    const auto match = match_expression(query, mode);
+    sqlite3_stmt *stmt = nullptr;
+    check_sqlite(sqlite3_prepare_v2(database_->handle(), sql.c_str(), -1, &stmt, nullptr));
+    sqlite3_bind_text(stmt, 1, match.c_str(), -1, SQLITE_TRANSIENT);
     sqlite3_bind_int(stmt, 2, static_cast<int>(limit));
     sqlite3_bind_int(stmt, 3, static_cast<int>(offset));
+    if (!filter.empty()) {
+        sqlite3_bind_pointer(stmt, 4, &allowed, doc_set_pointer_type, nullptr);
+    }
 
     std::vector<search_hit> hits;
     while (true) {
@@ -67,12 +319,252 @@ std::vector<search_hit> query_service::search(const std::string &query,
     return hits;
 }
 
+std::vector<search_hit> query_service::search_ranked(const std::string &query,
+                                                     std::size_t limit,
+                                                     std::size_t offset,
+                                                     match_mode mode,
+                                                     const std::vector<std::uint64_t> *allowed,
+                                                     const bm25_stats *corpus) const
+{
+    const std::size_t wanted = limit + offset;
+    if (wanted == 0U) {
+        return {};
+    }
+    const std::string table = fts_table(mode);
+    // docs_fts_title has a single column, so only recency applies to it.
+    const std::string weights = mode == match_mode::titles ? "" : ", ?2, ?3";
+    const std::string score = corpus == nullptr ? "bm25(" + table + weights + ")"
+                                                : std::string{global_bm25_name} + "(" + table + ", " + corpus_arguments(*corpus) + weights + ")";
+    std::string sql = "SELECT rowid, " + score + " FROM " + table + " WHERE " + table + " MATCH ?1";
+    if (allowed != nullptr) {
+        sql += " AND retort_allowed(?4, rowid)";
+    }
+    const auto match = match_expression(query, mode);
+    sqlite3_stmt *stmt = nullptr;
+    check_sqlite(sqlite3_prepare_v2(database_->handle(), sql.c_str(), -1, &stmt, nullptr));
+    sqlite3_bind_text(stmt, 1, match.c_str(), -1, SQLITE_TRANSIENT);
+    if (mode != match_mode::titles) {
+        sqlite3_bind_double(stmt, 2, ranking_.title_weight);
+        sqlite3_bind_double(stmt, 3, ranking_.body_weight);
+    }
+    if (allowed != nullptr) {
+        sqlite3_bind_pointer(stmt, 4, const_cast<std::vector<std::uint64_t> *>(allowed), doc_set_pointer_type, nullptr);
+    }
+
+    const double scale = recency_.empty()
+                             ? 0.0
+                             : std::exp2(-static_cast<double>(std::time(nullptr) - newest_update_) /
+                                         (ranking_.recency_half_life_days * seconds_per_day));
+    // Max-heap on (score, rowid), lower scores being better as with bm25:
+    // the front is the worst hit kept so far.
+    std::vector<std::pair<double, std::int64_t>> top;
+    top.reserve(wanted + 1U);
+    sqlite3_stmt *added = nullptr;
+    int step = SQLITE_ROW;
+    while ((step = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const auto rowid = sqlite3_column_int64(stmt, 0);
+        const std::pair<double, std::int64_t> candidate{
+            sqlite3_column_double(stmt, 1) * recency_factor(rowid, scale, added), rowid};
+        if (top.size() < wanted) {
+            top.push_back(candidate);
+            std::push_heap(top.begin(), top.end());
+        }
+        else if (candidate < top.front()) {
+            std::pop_heap(top.begin(), top.end());
+            top.back() = candidate;
+            std::push_heap(top.begin(), top.end());
+        }
+    }
+    sqlite3_finalize(added);
+    sqlite3_finalize(stmt);
+    if (step != SQLITE_DONE) {
+        throw std::runtime_error("failed to read search result");
+    }
+    std::sort_heap(top.begin(), top.end());
+    if (top.size() <= offset) {
+        return {};
+    }
+    top.erase(top.begin(), top.begin() + static_cast<std::ptrdiff_t>(offset));
+
+    // One more pass over the same match, seeking to the page's rowid range
+    // and skipping everything else, so snippet() runs for the page only.
+    std::vector<std::uint64_t> page;
+    std::int64_t first = top.front().second;
+    std::int64_t last = first;
+    for (const auto &entry : top) {
+        dense_insert(page, static_cast<std::uint64_t>(entry.second));
+        first = std::min(first, entry.second);
+        last = std::max(last, entry.second);
+    }
+    const int snippet_column = mode == match_mode::titles ? 0 : 1;
+    const std::string page_sql =
+        "SELECT " + table + ".rowid, d.url, d.title, d.format, d.tags, d.lang, d.updated_at,"
+        " snippet(" + table + ", " + std::to_string(snippet_column) + ", '<mark>', '</mark>', '...', 24)"
+        " FROM " + table +
+        " JOIN docs d ON d.id = " + table + ".rowid"
+        " WHERE " + table + " MATCH ?1 AND " + table + ".rowid BETWEEN ?2 AND ?3"
+        " AND retort_allowed(?4, " + table + ".rowid)";
+    check_sqlite(sqlite3_prepare_v2(database_->handle(), page_sql.c_str(), -1, &stmt, nullptr));
+    sqlite3_bind_text(stmt, 1, match.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 2, first);
+    sqlite3_bind_int64(stmt, 3, last);
+    sqlite3_bind_pointer(stmt, 4, &page, doc_set_pointer_type, nullptr);
+
+    std::vector<search_hit> hits(top.size());
+    while ((step = sqlite3_step(stmt)) == SQLITE_ROW) {
+        const auto rowid = sqlite3_column_int64(stmt, 0);
+        const auto it = std::find_if(top.begin(), top.end(), [rowid](const auto &entry) { return entry.second == rowid; });
+        auto &hit = hits[static_cast<std::size_t>(it - top.begin())];
+        hit.url = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 1));
+        hit.title = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 2));
+        hit.format = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 3));
+        hit.tags_json = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 4));
+        const auto lang_text = sqlite3_column_text(stmt, 5);
+        hit.lang = lang_text ? reinterpret_cast<const char *>(lang_text) : std::string{};
+        hit.updated_at = sqlite3_column_int64(stmt, 6);
+        hit.score = it->first;
+        const auto snippet_text = sqlite3_column_text(stmt, 7);
+        hit.snippet = snippet_text ? reinterpret_cast<const char *>(snippet_text) : std::string{};
+    }
+    sqlite3_finalize(stmt);
+    if (step != SQLITE_DONE) {
+        throw std::runtime_error("failed to read search result");
+    }
+    // A --watch commit between the two passes can drop a winner.
+    std::erase_if(hits, [](const search_hit &hit) { return hit.url.empty(); });
+    return hits;
+}
+
+// Phrase counts come from the first matching row; without one, a plain scan
+// of a single row still reports the table's rows and tokens.
+bm25_stats query_service::query_stats(const std::string &query, match_mode mode) const
+{
+    if (memory_ && mode == match_mode::words) {
+        auto stats = memory_->query_stats(query);
+        if (stats.has_value()) {
+            return std::move(*stats);
+        }
+        if (database_ == nullptr) {
+            throw std::runtime_error("query syntax is not supported by segment indexes");
+        }
+    }
+    const std::string table = fts_table(mode);
+    const std::string select = std::string{"SELECT "} + bm25_stats_name + "(" + table + ") FROM " + table;
+    const auto match = match_expression(query, mode);
+    bm25_stats stats;
+    for (const auto &sql : {select + " WHERE " + table + " MATCH ?1 LIMIT 1", select + " LIMIT 1"}) {
+        sqlite3_stmt *stmt = nullptr;
+        check_sqlite(sqlite3_prepare_v2(database_->handle(), sql.c_str(), -1, &stmt, nullptr));
+        sqlite3_bind_text(stmt, 1, match.c_str(), -1, SQLITE_TRANSIENT);
+        const int step = sqlite3_step(stmt);
+        if (step == SQLITE_ROW) {
+            std::istringstream fields{reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0))};
+            fields >> stats.rows >> stats.tokens;
+            std::int64_t docs = 0;
+            while (fields >> docs) {
+                stats.phrase_docs.push_back(docs);
+            }
+        }
+        sqlite3_finalize(stmt);
+        if (step == SQLITE_ROW) {
+            break;
+        }
+        if (step != SQLITE_DONE) {
+            throw std::runtime_error("failed to read bm25 statistics");
+        }
+    }
+    return stats;
+}
+
+// Rows the watcher inserted after startup are past the end of recency_ and
+// read their updated_at from docs; an edited row keeps its rowid and its
+// startup decay until the index is reopened.
+double query_service::recency_factor(std::int64_t rowid, double scale, sqlite3_stmt *&added) const
+{
+    if (recency_.empty()) {
+        return 1.0;
+    }
+    const auto index = static_cast<std::size_t>(rowid);
+    if (rowid >= 0 && index < recency_.size()) {
+        return 1.0 + ranking_.recency_boost * scale * recency_[index];
+    }
+    if (added == nullptr) {
+        check_sqlite(sqlite3_prepare_v2(database_->handle(), "SELECT updated_at FROM docs WHERE id = ?", -1, &added, nullptr));
+    }
+    sqlite3_reset(added);
+    sqlite3_bind_int64(added, 1, rowid);
+    double decay = 1.0;
+    if (sqlite3_step(added) == SQLITE_ROW) {
+        const auto age = static_cast<double>(newest_update_ - sqlite3_column_int64(added, 0));
+        decay = std::exp2(-age / (ranking_.recency_half_life_days * seconds_per_day));
+    }
+    return 1.0 + ranking_.recency_boost * scale * decay;
+}
+
+std::vector<std::vector<facet_count>> query_service::facet_counts(const std::string &query,
+                                                                 match_mode mode,
+                                                                 const search_filter &filter,
+                                                                 const std::vector<std::string> &kinds) const
+{
+    if (facets_.empty()) {
+        throw std::runtime_error("facets are not available for this index");
+    }
+    std::vector<std::uint64_t> allowed;
+    if (!filter.empty()) {
+        allowed = facets_.resolve(filter);
+        if (allowed.empty()) {
+            return std::vector<std::vector<facet_count>>(kinds.size());
+        }
+    }
+    const auto *allowed_set = filter.empty() ? nullptr : &allowed;
+
+    std::optional<std::vector<std::uint64_t>> set;
+    if (memory_ && mode == match_mode::words) {
+        set = memory_->match_set(query, allowed_set);
+    }
+    if (!set.has_value()) {
+        // Only rowids are read, so FTS5 neither ranks nor touches docs.
+        const std::string table = fts_table(mode);
+        std::string sql = "SELECT rowid FROM " + table + " WHERE " + table + " MATCH ?1";
+        if (allowed_set != nullptr) {
+            sql += " AND retort_allowed(?2, rowid)";
+        }
+        const auto match = match_expression(query, mode);
+        sqlite3_stmt *stmt = nullptr;
+        check_sqlite(sqlite3_prepare_v2(database_->handle(), sql.c_str(), -1, &stmt, nullptr));
+        sqlite3_bind_text(stmt, 1, match.c_str(), -1, SQLITE_TRANSIENT);
+        if (allowed_set != nullptr) {
+            sqlite3_bind_pointer(stmt, 2, &allowed, doc_set_pointer_type, nullptr);
+        }
+        set.emplace();
+        int step = SQLITE_ROW;
+        while ((step = sqlite3_step(stmt)) == SQLITE_ROW) {
+            dense_insert(*set, static_cast<std::uint64_t>(sqlite3_column_int64(stmt, 0)));
+        }
+        sqlite3_finalize(stmt);
+        if (step != SQLITE_DONE) {
+            throw std::runtime_error("failed to read matching documents");
+        }
+    }
+
+    std::vector<std::vector<facet_count>> counts;
+    counts.reserve(kinds.size());
+    for (const auto &kind : kinds) {
+        counts.push_back(facets_.count(kind, *set));
+    }
+    return counts;
+}
+
 meta_info query_service::load_meta() const
 {
+    if (database_ == nullptr) {
+        return memory_->load_meta();
+    }
     sqlite3_stmt *stmt = nullptr;
     const char *sql = "SELECT key, value FROM meta";
-    check_sqlite(sqlite3_prepare_v2(database_.handle(), sql, -1, &stmt, nullptr));
+    check_sqlite(sqlite3_prepare_v2(database_->handle(), sql, -1, &stmt, nullptr));
     meta_info info;
+    info.schema_version = "1";
     while (true) {
         const int step = sqlite3_step(stmt);
         if (step == SQLITE_ROW) {
@@ -90,6 +582,18 @@ meta_info query_service::load_meta() const
             else if (key == "doc_count") {
                 info.doc_count = static_cast<std::size_t>(std::stoull(value));
             }
+            else if (key == "prefix_index") {
+                info.prefix_index = parse_prefix_index_meta(value);
+            }
+            else if (key == "prefix_fanout") {
+                info.prefix_fanout = static_cast<std::size_t>(std::stoull(value));
+            }
+            else if (key == "trigram") {
+                info.trigram = value == "1";
+            }
+            else if (key == "hot_prefix_hits") {
+                info.hot_prefix_hits = static_cast<std::size_t>(std::stoull(value));
+            }
             continue;
         }
         if (step == SQLITE_DONE) {
@@ -101,4 +605,40 @@ meta_info query_service::load_meta() const
     sqlite3_finalize(stmt);
     return info;
 }
+
+const std::vector<std::string> *query_service::hot_hits(const std::string &prefix) const
+{
+    const auto it = hot_hits_.find(prefix);
+    return it == hot_hits_.end() ? nullptr : &it->second;
+}
+
+const term_dictionary &query_service::dictionary() const noexcept
+{
+    return dictionary_;
+}
+
+const spelling_index &query_service::spelling() const noexcept
+{
+    return spelling_;
+}
+
+const completion_index &query_service::completions() const noexcept
+{
+    return completions_;
+}
+
+bool query_service::supports_query(const std::string &query) const
+{
+    return database_ != nullptr || memory_->supports(query);
+}
+
+bool query_service::has_title_index() const noexcept
+{
+    return title_index_;
+}
+
+const facet_index &query_service::facets() const noexcept
+{
+    return facets_;
+}
 }
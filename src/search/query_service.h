@@ -2,11 +2,17 @@
 
 #include "config/app_config.h"
 #include "index/sqlite_database.h"
+#include "search/completion_index.h"
+#include "search/facet_index.h"
+#include "search/spelling_index.h"
+#include "search/term_dictionary.h"
 
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <optional>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace retort
@@ -29,20 +35,114 @@ struct meta_info
     std::string repo_commit;
     std::string built_at;
     std::size_t doc_count = 0U;
+    std::vector<std::size_t> prefix_index;
+    std::size_t prefix_fanout = 0U;
+    std::size_t hot_prefix_hits = 0U;
+    bool trigram = false;
 };
 
+// bm25's corpus-wide inputs for one query: rows, their total length in
+// tokens and, per phrase in query order, the rows containing it. Shards sum
+// theirs so that every shard scores against the whole corpus.
+struct bm25_stats
+{
+    std::int64_t rows = 0;
+    std::int64_t tokens = 0;
+    std::vector<std::int64_t> phrase_docs;
+};
+
+// The JSON object /search returns for one hit.
+std::string to_json(const search_hit &hit);
+
+// words: FTS5 query syntax against docs_fts. substring: the query is a
+// literal fragment matched anywhere in title or body through docs_fts_tri
+// (retort write --trigram). titles: the words query against titles alone
+// through docs_fts_title, with the highlighted title as snippet.
+enum class match_mode
+{
+    words,
+    substring,
+    titles
+};
+
+class memory_index;
+
 class query_service
 {
 public:
-    explicit query_service(sqlite_database &database);
+    explicit query_service(sqlite_database &database,
+                           search_engine engine = search_engine::sqlite,
+                           const ranking_config &ranking = {});
+    // Serves a mapped segment only; there is no SQL path to fall back to.
+    explicit query_service(std::unique_ptr<memory_index> segment);
+    ~query_service();
 
     std::vector<search_hit> search(const std::string &query,
                                    std::size_t limit,
-                                   std::size_t offset) const;
+                                   std::size_t offset,
+                                   match_mode mode = match_mode::words,
+                                   const search_filter &filter = {},
+                                   const bm25_stats *corpus = nullptr) const;
+
+    // This index's share of the statistics corpus passes to search(). The
+    // SQL path only knows phrase counts when a row matches the query, so
+    // phrase_docs is empty when none does.
+    bm25_stats query_stats(const std::string &query, match_mode mode) const;
+
+    // Per kind in kinds ("tag", "lang", "format"), the values carried by
+    // the documents matching query and filter with their counts. Needs the
+    // facet bitmaps, like a filter.
+    std::vector<std::vector<facet_count>> facet_counts(const std::string &query,
+                                                       match_mode mode,
+                                                       const search_filter &filter,
+                                                       const std::vector<std::string> &kinds) const;
 
     meta_info load_meta() const;
 
+    // Hit JSON the writer precomputed for a 2- or 3-character prefix
+    // (retort write --hot-prefixes), best first; nullptr when there is none.
+    const std::vector<std::string> *hot_hits(const std::string &prefix) const;
+
+    // The indexed vocabulary; empty for segments and older indexes.
+    const term_dictionary &dictionary() const noexcept;
+    const spelling_index &spelling() const noexcept;
+    const completion_index &completions() const noexcept;
+    // False only for a segment given a query with operators or phrases,
+    // which it has no SQL path to evaluate.
+    bool supports_query(const std::string &query) const;
+    // Whether match_mode::titles is available; false for segments and
+    // indexes written before docs_fts_title.
+    bool has_title_index() const noexcept;
+    // Empty for segments and indexes written before facet bitmaps, which
+    // cannot be searched with a filter.
+    const facet_index &facets() const noexcept;
+
 private:
-    sqlite_database &database_;
+    // Custom ranking: streams every match's rowid and bm25 score, keeps the
+    // best limit + offset in a heap, then reads rows and snippets for the
+    // page alone.
+    std::vector<search_hit> search_ranked(const std::string &query,
+                                          std::size_t limit,
+                                          std::size_t offset,
+                                          match_mode mode,
+                                          const std::vector<std::uint64_t> *allowed,
+                                          const bm25_stats *corpus) const;
+    // added is prepared on first use, for rowids written after startup.
+    double recency_factor(std::int64_t rowid, double scale, sqlite3_stmt *&added) const;
+
+    sqlite_database *database_ = nullptr;
+    int schema_version_ = 1;
+    std::unique_ptr<memory_index> memory_;
+    std::unordered_map<std::string, std::vector<std::string>> hot_hits_;
+    term_dictionary dictionary_;
+    spelling_index spelling_;
+    completion_index completions_;
+    facet_index facets_;
+    bool title_index_ = false;
+    ranking_config ranking_;
+    // Per rowid, 0.5^((updated_at - newest) / half life); only loaded when
+    // recency_boost is set.
+    std::vector<float> recency_;
+    std::int64_t newest_update_ = 0;
 };
 }
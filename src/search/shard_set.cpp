@@ -0,0 +1,203 @@
+#include "shard_set.h"
+
+#include "index/segment_file.h"
+#include "index/shard_manifest.h"
+#include "search/memory_index.h"
+
+#include <algorithm>
+#include <functional>
+#include <future>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+namespace retort
+{
+shard_set::shard_set(const std::string &index_path, search_engine engine, const ranking_config &ranking) {
+    std::vector<std::filesystem::path> files;
+    const auto manifest = read_shard_manifest(index_path);
+    if (manifest.has_value()) {
+        files = *manifest;
+    }
+    else {
+        files.emplace_back(index_path);
+    }
+    shards_.reserve(files.size());
+    for (const auto &file : files) {
+        shard entry;
+        if (is_segment_file(file)) {
+            if (!ranking.is_default()) {
+                throw std::runtime_error("custom ranking is not supported by segment indexes");
+            }
+            entry.queries = std::make_unique<query_service>(std::make_unique<memory_index>(file));
+            shards_.push_back(std::move(entry));
+            continue;
+        }
+        entry.database = std::make_unique<sqlite_database>(file.string(), SQLITE_OPEN_READONLY);
+        entry.queries = std::make_unique<query_service>(*entry.database, engine, ranking);
+        shards_.push_back(std::move(entry));
+    }
+}
+
+// Every shard returns its own top offset+limit; the global page is cut from
+// the merged list. Each shard's own bm25 statistics would make scores
+// incomparable (a term in over half of one shard's rows gets an idf near zero
+// there alone), so a first pass sums rows, tokens and phrase counts over the
+// shards and every shard then scores against those. The SQL path learns
+// phrase counts only from shards where the query matches, so a shard holding
+// some of the phrases but no match leaves them out of the sums.
+std::vector<search_hit> shard_set::search(const std::string &query,
+                                          std::size_t limit,
+                                          std::size_t offset,
+                                          match_mode mode,
+                                          const search_filter &filter) const
+{
+    if (shards_.size() == 1U) {
+        return shards_.front().queries->search(query, limit, offset, mode, filter);
+    }
+
+    std::vector<std::future<bm25_stats>> counting;
+    counting.reserve(shards_.size());
+    for (const auto &entry : shards_) {
+        counting.push_back(std::async(std::launch::async, [&entry, &query, mode]() {
+            return entry.queries->query_stats(query, mode);
+        }));
+    }
+    bm25_stats corpus;
+    for (auto &future : counting) {
+        const auto stats = future.get();
+        corpus.rows += stats.rows;
+        corpus.tokens += stats.tokens;
+        if (corpus.phrase_docs.empty()) {
+            corpus.phrase_docs.resize(stats.phrase_docs.size(), 0);
+        }
+        if (stats.phrase_docs.size() == corpus.phrase_docs.size()) {
+            std::transform(stats.phrase_docs.begin(), stats.phrase_docs.end(), corpus.phrase_docs.begin(),
+                           corpus.phrase_docs.begin(), std::plus<>{});
+        }
+        else if (!stats.phrase_docs.empty()) {
+            throw std::runtime_error("shards disagree on the phrases of a query");
+        }
+    }
+    if (corpus.phrase_docs.empty()) {
+        return {};
+    }
+
+    std::vector<std::future<std::vector<search_hit>>> pending;
+    pending.reserve(shards_.size());
+    for (const auto &entry : shards_) {
+        pending.push_back(std::async(std::launch::async, [&entry, &query, limit, offset, mode, &filter, &corpus]() {
+            return entry.queries->search(query, limit + offset, 0U, mode, filter, &corpus);
+        }));
+    }
+
+    std::vector<search_hit> merged;
+    for (auto &future : pending) {
+        auto hits = future.get();
+        merged.insert(merged.end(), std::make_move_iterator(hits.begin()), std::make_move_iterator(hits.end()));
+    }
+    std::stable_sort(merged.begin(), merged.end(), [](const search_hit &lhs, const search_hit &rhs) {
+        return lhs.score < rhs.score;
+    });
+
+    if (offset >= merged.size()) {
+        return {};
+    }
+    const auto end = std::min(merged.size(), offset + limit);
+    return std::vector<search_hit>{std::make_move_iterator(merged.begin() + static_cast<std::ptrdiff_t>(offset)),
+                                   std::make_move_iterator(merged.begin() + static_cast<std::ptrdiff_t>(end))};
+}
+
+std::vector<std::vector<facet_count>> shard_set::facet_counts(const std::string &query,
+                                                             match_mode mode,
+                                                             const search_filter &filter,
+                                                             const std::vector<std::string> &kinds) const
+{
+    if (shards_.size() == 1U) {
+        return shards_.front().queries->facet_counts(query, mode, filter, kinds);
+    }
+
+    std::vector<std::future<std::vector<std::vector<facet_count>>>> pending;
+    pending.reserve(shards_.size());
+    for (const auto &entry : shards_) {
+        pending.push_back(std::async(std::launch::async, [&entry, &query, mode, &filter, &kinds]() {
+            return entry.queries->facet_counts(query, mode, filter, kinds);
+        }));
+    }
+
+    std::vector<std::map<std::string, std::size_t>> totals(kinds.size());
+    for (auto &future : pending) {
+        const auto counts = future.get();
+        for (std::size_t k = 0U; k < counts.size(); ++k) {
+            for (const auto &entry : counts[k]) {
+                totals[k][entry.value] += entry.count;
+            }
+        }
+    }
+    std::vector<std::vector<facet_count>> merged(kinds.size());
+    for (std::size_t k = 0U; k < totals.size(); ++k) {
+        for (const auto &[value, count] : totals[k]) {
+            merged[k].push_back(facet_count{value, count});
+        }
+        sort_counts(merged[k]);
+    }
+    return merged;
+}
+
+meta_info shard_set::load_meta() const
+{
+    meta_info combined = shards_.front().queries->load_meta();
+    for (std::size_t i = 1U; i < shards_.size(); ++i) {
+        const auto meta = shards_[i].queries->load_meta();
+        combined.doc_count += meta.doc_count;
+        combined.built_at = std::max(combined.built_at, meta.built_at);
+    }
+    return combined;
+}
+
+const std::vector<std::string> *shard_set::hot_hits(const std::string &prefix) const
+{
+    return shards_.size() == 1U ? shards_.front().queries->hot_hits(prefix) : nullptr;
+}
+
+const term_dictionary *shard_set::dictionary() const noexcept
+{
+    return shards_.size() == 1U ? &shards_.front().queries->dictionary() : nullptr;
+}
+
+const spelling_index *shard_set::spelling() const noexcept
+{
+    return shards_.size() == 1U ? &shards_.front().queries->spelling() : nullptr;
+}
+
+const completion_index *shard_set::completions() const noexcept
+{
+    return shards_.size() == 1U ? &shards_.front().queries->completions() : nullptr;
+}
+
+bool shard_set::has_facets() const noexcept
+{
+    return std::all_of(shards_.begin(), shards_.end(), [](const shard &entry) {
+        return !entry.queries->facets().empty();
+    });
+}
+
+bool shard_set::has_title_index() const noexcept
+{
+    return std::all_of(shards_.begin(), shards_.end(), [](const shard &entry) {
+        return entry.queries->has_title_index();
+    });
+}
+
+bool shard_set::supports_query(const std::string &query) const
+{
+    return std::all_of(shards_.begin(), shards_.end(), [&query](const shard &entry) {
+        return entry.queries->supports_query(query);
+    });
+}
+
+std::size_t shard_set::size() const noexcept
+{
+    return shards_.size();
+}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "index/sqlite_database.h"
+#include "search/query_service.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace retort
+{
+// One or more index files opened read-only. A plain index is a set of one;
+// a shard manifest opens every shard it lists and queries them in parallel.
+// Segment files are mapped and served by memory_index whatever the engine.
+class shard_set
+{
+public:
+    explicit shard_set(const std::string &index_path,
+                       search_engine engine = search_engine::sqlite,
+                       const ranking_config &ranking = {});
+
+    std::vector<search_hit> search(const std::string &query,
+                                   std::size_t limit,
+                                   std::size_t offset,
+                                   match_mode mode = match_mode::words,
+                                   const search_filter &filter = {}) const;
+
+    // Counts are taken per shard and summed.
+    std::vector<std::vector<facet_count>> facet_counts(const std::string &query,
+                                                       match_mode mode,
+                                                       const search_filter &filter,
+                                                       const std::vector<std::string> &kinds) const;
+
+    meta_info load_meta() const;
+
+    // Precomputed hits are per file, so only a single index serves them.
+    const std::vector<std::string> *hot_hits(const std::string &prefix) const;
+
+    // Likewise the vocabulary; nullptr unless there is a single index.
+    const term_dictionary *dictionary() const noexcept;
+    const spelling_index *spelling() const noexcept;
+    const completion_index *completions() const noexcept;
+    // Each shard filters against its own bitmaps, so every one needs them.
+    bool has_facets() const noexcept;
+    bool has_title_index() const noexcept;
+    bool supports_query(const std::string &query) const;
+
+    std::size_t size() const noexcept;
+
+private:
+    struct shard
+    {
+        std::unique_ptr<sqlite_database> database;
+        std::unique_ptr<query_service> queries;
+    };
+
+    std::vector<shard> shards_;
+};
+}
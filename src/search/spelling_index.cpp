@@ -0,0 +1,166 @@
+#include "spelling_index.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace retort
+{
+namespace
+{
+std::uint64_t variant_hash(std::string_view variant) {
+    std::uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char ch : variant) {
+        hash = (hash ^ ch) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Levenshtein distance that also counts swapping two adjacent bytes as one
+// edit; max_distance + 1 stands for anything beyond max_distance. Only the
+// band of cells within max_distance of the diagonal is computed. rows is
+// scratch space, reused across calls.
+std::size_t osa_distance(std::string_view lhs, std::string_view rhs, std::size_t max_distance, std::vector<std::size_t> &rows) {
+    const std::size_t over = max_distance + 1U;
+    const std::size_t width = rhs.size() + 1U;
+    rows.resize(3U * width);
+    std::size_t *before = rows.data();
+    std::size_t *previous = before + width;
+    std::size_t *current = previous + width;
+    for (std::size_t j = 0U; j < width; ++j) {
+        previous[j] = j;
+    }
+    std::size_t previous_min = 0U;
+    for (std::size_t i = 1U; i <= lhs.size(); ++i) {
+        const std::size_t low = i > max_distance ? i - max_distance : 1U;
+        const std::size_t high = std::min(i + max_distance, rhs.size());
+        current[low - 1U] = low == 1U ? i : over;
+        if (high + 1U < width) {
+            current[high + 1U] = over;
+        }
+        std::size_t row_min = current[low - 1U];
+        for (std::size_t j = low; j <= high; ++j) {
+            const std::size_t cost = lhs[i - 1U] == rhs[j - 1U] ? 0U : 1U;
+            current[j] = std::min({previous[j] + 1U, current[j - 1U] + 1U, previous[j - 1U] + cost});
+            if (i > 1U && j > 1U && lhs[i - 1U] == rhs[j - 2U] && lhs[i - 2U] == rhs[j - 1U]) {
+                current[j] = std::min(current[j], before[j - 2U] + 1U);
+            }
+            row_min = std::min(row_min, current[j]);
+        }
+        // A transposition reaches back two rows, so both must be over budget.
+        if (row_min > max_distance && previous_min > max_distance) {
+            return over;
+        }
+        previous_min = row_min;
+        std::swap(before, previous);
+        std::swap(previous, current);
+    }
+    return std::min(previous[rhs.size()], over);
+}
+}
+
+std::vector<std::string> spelling_variants(std::string_view word, std::size_t max_edits) {
+    std::vector<std::string> variants{std::string{word.substr(0U, spelling_prefix)}};
+    std::size_t level_begin = 0U;
+    for (std::size_t edit = 0U; edit < max_edits; ++edit) {
+        const std::size_t level_end = variants.size();
+        for (std::size_t v = level_begin; v < level_end; ++v) {
+            for (std::size_t i = 0U; i < variants[v].size(); ++i) {
+                std::string shorter = variants[v];
+                shorter.erase(i, 1U);
+                variants.push_back(std::move(shorter));
+            }
+        }
+        level_begin = level_end;
+    }
+    std::sort(variants.begin(), variants.end());
+    variants.erase(std::unique(variants.begin(), variants.end()), variants.end());
+    return variants;
+}
+
+spelling_index::spelling_index(sqlite3 *db)
+{
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, "SELECT variant, term_ids FROM spelling_deletes", -1, &stmt, nullptr) != SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        return;
+    }
+    std::vector<slot> entries;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const std::string_view variant{reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0)),
+                                       static_cast<std::size_t>(sqlite3_column_bytes(stmt, 0))};
+        const auto *ids = static_cast<const unsigned char *>(sqlite3_column_blob(stmt, 1));
+        const auto count = static_cast<std::size_t>(sqlite3_column_bytes(stmt, 1)) / sizeof(std::uint32_t);
+        if (count == 0U) {
+            continue;
+        }
+        const auto begin = static_cast<std::uint32_t>(term_ids_.size());
+        term_ids_.resize(term_ids_.size() + count);
+        std::memcpy(term_ids_.data() + begin, ids, count * sizeof(std::uint32_t));
+        entries.push_back(slot{variant_hash(variant), begin, static_cast<std::uint32_t>(term_ids_.size())});
+    }
+    sqlite3_finalize(stmt);
+    if (entries.empty()) {
+        return;
+    }
+
+    std::size_t capacity = 1U;
+    while (capacity < entries.size() + entries.size() / 2U) {
+        capacity *= 2U;
+    }
+    slots_.resize(capacity);
+    for (const auto &entry : entries) {
+        auto pos = entry.hash & (capacity - 1U);
+        while (slots_[pos].begin != slots_[pos].end) {
+            pos = (pos + 1U) & (capacity - 1U);
+        }
+        slots_[pos] = entry;
+    }
+}
+
+bool spelling_index::empty() const noexcept
+{
+    return slots_.empty();
+}
+
+std::optional<std::string> spelling_index::correct(std::string_view word, const term_dictionary &dictionary) const
+{
+    const std::size_t max_distance = std::min<std::size_t>(word.size() <= 5U ? 1U : 2U, max_spelling_edits);
+    // Terms share variants, so the candidates are collected and deduplicated
+    // before any distance is computed.
+    std::vector<std::uint32_t> candidates;
+    const auto mask = slots_.size() - 1U;
+    for (const auto &variant : spelling_variants(word, max_distance)) {
+        const auto hash = variant_hash(variant);
+        for (auto pos = hash & mask; slots_[pos].begin != slots_[pos].end; pos = (pos + 1U) & mask) {
+            if (slots_[pos].hash == hash) {
+                candidates.insert(candidates.end(), term_ids_.begin() + slots_[pos].begin, term_ids_.begin() + slots_[pos].end);
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    std::optional<std::uint32_t> best;
+    std::size_t best_distance = max_distance + 1U;
+    std::vector<std::size_t> rows;
+    for (const auto id : candidates) {
+        if (id >= dictionary.size()) {
+            continue;
+        }
+        const auto term = dictionary.term(id);
+        const std::size_t gap = term.size() > word.size() ? term.size() - word.size() : word.size() - term.size();
+        if (gap > max_distance) {
+            continue;
+        }
+        const auto distance = osa_distance(word, term, max_distance, rows);
+        if (distance < best_distance || (distance == best_distance && best.has_value() && dictionary.doc_freq(id) > dictionary.doc_freq(*best))) {
+            best = id;
+            best_distance = distance;
+        }
+    }
+    if (!best.has_value()) {
+        return std::nullopt;
+    }
+    return std::string{dictionary.term(*best)};
+}
+}
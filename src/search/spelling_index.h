@@ -0,0 +1,58 @@
+#pragma once
+
+#include "search/term_dictionary.h"
+
+#include <sqlite3.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace retort
+{
+// Deletes are taken from this many leading bytes of a word, which bounds
+// their number per term; candidates are still checked on the whole word.
+constexpr std::size_t spelling_prefix = 7U;
+constexpr std::size_t max_spelling_edits = 2U;
+
+// Every distinct string left after deleting up to max_edits bytes from the
+// first spelling_prefix bytes of word, the untouched prefix included.
+std::vector<std::string> spelling_variants(std::string_view word, std::size_t max_edits);
+
+// A SymSpell symmetric delete index over the term dictionary, as the writer
+// stores it in spelling_deletes: each variant of an ASCII term of three or
+// more bytes maps to the ids of the terms it came from. A misspelt word's own
+// variants find every term within the edit budget with a few hash probes.
+class spelling_index
+{
+public:
+    spelling_index() = default;
+    // Empty when the index has no spelling_deletes table.
+    explicit spelling_index(sqlite3 *db);
+
+    bool empty() const noexcept;
+
+    // The dictionary term closest to word by optimal string alignment
+    // distance, within one edit for words of up to 5 bytes and two beyond,
+    // and the more frequent one among ties; nullopt when there is none.
+    std::optional<std::string> correct(std::string_view word, const term_dictionary &dictionary) const;
+
+private:
+    // Variants are keyed by a 64-bit hash alone; a collision only adds
+    // candidates, which are checked against the word anyway.
+    struct slot
+    {
+        std::uint64_t hash = 0U;
+        std::uint32_t begin = 0U;
+        std::uint32_t end = 0U;
+    };
+
+    // Linear-probing table of the variants' [begin, end) ranges in term_ids_;
+    // its size is a power of two and an empty range marks a free slot.
+    std::vector<slot> slots_;
+    std::vector<std::uint32_t> term_ids_;
+};
+}
@@ -0,0 +1,219 @@
+#include "term_dictionary.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace retort
+{
+term_dictionary::term_dictionary(sqlite3 *db)
+{
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, "SELECT term, doc_freq FROM term_dictionary ORDER BY term", -1, &stmt, nullptr) != SQLITE_OK) {
+        sqlite3_finalize(stmt);
+        return;
+    }
+    offsets_.push_back(0U);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const auto *text = static_cast<const char *>(sqlite3_column_blob(stmt, 0));
+        text_.append(text, static_cast<std::size_t>(sqlite3_column_bytes(stmt, 0)));
+        offsets_.push_back(static_cast<std::uint32_t>(text_.size()));
+        doc_freqs_.push_back(static_cast<std::uint32_t>(sqlite3_column_int64(stmt, 1)));
+    }
+    sqlite3_finalize(stmt);
+}
+
+bool term_dictionary::empty() const noexcept
+{
+    return doc_freqs_.empty();
+}
+
+std::size_t term_dictionary::size() const noexcept
+{
+    return doc_freqs_.size();
+}
+
+std::string_view term_dictionary::term(std::size_t index) const
+{
+    return std::string_view{text_}.substr(offsets_[index], offsets_[index + 1U] - offsets_[index]);
+}
+
+std::uint32_t term_dictionary::doc_freq(std::size_t index) const
+{
+    return doc_freqs_[index];
+}
+
+bool term_dictionary::contains(std::string_view term) const
+{
+    std::size_t low = 0U;
+    std::size_t high = size();
+    while (low < high) {
+        const auto mid = low + (high - low) / 2U;
+        if (this->term(mid) < term) {
+            low = mid + 1U;
+        }
+        else {
+            high = mid;
+        }
+    }
+    return low < size() && this->term(low) == term;
+}
+
+bool term_dictionary::has_prefix(std::string_view prefix) const
+{
+    std::size_t low = 0U;
+    std::size_t high = size();
+    while (low < high) {
+        const auto mid = low + (high - low) / 2U;
+        if (term(mid) < prefix) {
+            low = mid + 1U;
+        }
+        else {
+            high = mid;
+        }
+    }
+    return low < size() && term(low).starts_with(prefix);
+}
+
+std::vector<std::string_view> term_dictionary::top_expansions(std::string_view prefix, std::size_t limit) const
+{
+    const auto lower_bound = [this](auto &&before) {
+        std::size_t low = 0U;
+        std::size_t high = size();
+        while (low < high) {
+            const auto mid = low + (high - low) / 2U;
+            if (before(term(mid))) {
+                low = mid + 1U;
+            }
+            else {
+                high = mid;
+            }
+        }
+        return low;
+    };
+    const auto first = lower_bound([prefix](std::string_view term) { return term < prefix; });
+    const auto last = lower_bound([prefix](std::string_view term) { return term < prefix || term.starts_with(prefix); });
+    if (limit == 0U || last - first <= limit) {
+        return {};
+    }
+    std::vector<std::size_t> ids(last - first);
+    std::iota(ids.begin(), ids.end(), first);
+    const auto kept = ids.begin() + static_cast<std::ptrdiff_t>(limit);
+    std::partial_sort(ids.begin(), kept, ids.end(), [this](std::size_t lhs, std::size_t rhs) {
+        return doc_freqs_[lhs] > doc_freqs_[rhs] || (doc_freqs_[lhs] == doc_freqs_[rhs] && lhs < rhs);
+    });
+    std::sort(ids.begin(), kept);
+    std::vector<std::string_view> terms;
+    terms.reserve(limit);
+    for (auto it = ids.begin(); it != kept; ++it) {
+        terms.push_back(term(*it));
+    }
+    return terms;
+}
+
+// Every term in [first, last) starts with the same depth bytes, and rows
+// holds the DP row of that prefix at depth. The term equal to the prefix,
+// if any, sorts first; the rest split into runs by their next byte.
+void term_dictionary::walk(std::size_t first,
+                           std::size_t last,
+                           std::size_t depth,
+                           std::string_view word,
+                           bool prefix,
+                           std::size_t max_distance,
+                           std::vector<std::size_t> &rows,
+                           std::vector<match> &matches) const
+{
+    const std::size_t width = word.size() + 1U;
+    const std::size_t *row = rows.data() + depth * width;
+    if (row[word.size()] <= max_distance) {
+        if (prefix) {
+            matches.push_back(match{first, last, depth, row[word.size()]});
+        }
+        else if (term(first).size() == depth) {
+            matches.push_back(match{first, first + 1U, depth, row[word.size()]});
+        }
+    }
+    if (*std::min_element(row, row + width) > max_distance) {
+        return;
+    }
+
+    std::size_t pos = term(first).size() == depth ? first + 1U : first;
+    while (pos < last) {
+        const auto byte = static_cast<unsigned char>(term(pos)[depth]);
+        std::size_t low = pos + 1U;
+        std::size_t high = last;
+        while (low < high) {
+            const auto mid = low + (high - low) / 2U;
+            if (static_cast<unsigned char>(term(mid)[depth]) <= byte) {
+                low = mid + 1U;
+            }
+            else {
+                high = mid;
+            }
+        }
+
+        std::size_t *next = rows.data() + (depth + 1U) * width;
+        next[0] = depth + 1U;
+        for (std::size_t j = 1U; j < width; ++j) {
+            const std::size_t substitute = row[j - 1U] + (static_cast<unsigned char>(word[j - 1U]) == byte ? 0U : 1U);
+            next[j] = std::min({row[j] + 1U, next[j - 1U] + 1U, substitute});
+        }
+        walk(pos, low, depth + 1U, word, prefix, max_distance, rows, matches);
+        pos = low;
+    }
+}
+
+std::vector<std::string> term_dictionary::nearest(std::string_view word, bool prefix, std::size_t max_distance, std::size_t limit) const
+{
+    if (empty() || limit == 0U) {
+        return {};
+    }
+    // A branch dies once depth exceeds word.size() + max_distance, so the
+    // rows never outgrow this.
+    const std::size_t width = word.size() + 1U;
+    std::vector<std::size_t> rows((word.size() + max_distance + 2U) * width);
+    for (std::size_t j = 0U; j < width; ++j) {
+        rows[j] = j;
+    }
+    std::vector<match> matches;
+    walk(0U, size(), 0U, word, prefix, max_distance, rows, matches);
+    if (matches.empty()) {
+        return {};
+    }
+
+    const auto best = std::min_element(matches.begin(), matches.end(), [](const match &lhs, const match &rhs) {
+        return lhs.distance < rhs.distance;
+    })->distance;
+    std::vector<match> kept;
+    if (prefix) {
+        // Matches come in pre-order, so a nested one directly follows the
+        // prefix that covers it.
+        for (const auto &candidate : matches) {
+            if (candidate.distance != best) {
+                continue;
+            }
+            if (!kept.empty() && candidate.first >= kept.back().first && candidate.last <= kept.back().last) {
+                continue;
+            }
+            kept.push_back(candidate);
+        }
+        std::stable_sort(kept.begin(), kept.end(), [](const match &lhs, const match &rhs) {
+            return lhs.last - lhs.first > rhs.last - rhs.first;
+        });
+    }
+    else {
+        kept = std::move(matches);
+        std::stable_sort(kept.begin(), kept.end(), [this](const match &lhs, const match &rhs) {
+            if (lhs.distance != rhs.distance) {
+                return lhs.distance < rhs.distance;
+            }
+            return doc_freqs_[lhs.first] > doc_freqs_[rhs.first];
+        });
+    }
+
+    std::vector<std::string> result;
+    for (std::size_t i = 0U; i < kept.size() && i < limit; ++i) {
+        result.emplace_back(term(kept[i].first).substr(0U, kept[i].depth));
+    }
+    return result;
+}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <sqlite3.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace retort
+{
+// The sorted docs_fts vocabulary with document frequencies, as the writer
+// stores it in the term_dictionary table. Terms live back to back in one
+// buffer, so the sorted array doubles as an implicit byte trie: the terms
+// below a prefix are a contiguous range.
+class term_dictionary
+{
+public:
+    term_dictionary() = default;
+    // Empty when the index has no term_dictionary table.
+    explicit term_dictionary(sqlite3 *db);
+
+    bool empty() const noexcept;
+    std::size_t size() const noexcept;
+
+    // Terms are numbered in byte order, as the table sorts them.
+    std::string_view term(std::size_t index) const;
+    std::uint32_t doc_freq(std::size_t index) const;
+
+    bool contains(std::string_view term) const;
+    bool has_prefix(std::string_view prefix) const;
+
+    // The limit most frequent terms starting with prefix, in byte order,
+    // ties going to the earlier term as in the memory engine's prefix trie.
+    // Empty when no more than limit terms start with it.
+    std::vector<std::string_view> top_expansions(std::string_view prefix, std::size_t limit) const;
+
+    // Up to limit entries within max_distance byte edits (Levenshtein) of
+    // word, closest first. Walks the trie with one DP row per depth and
+    // prunes every branch whose row exceeds max_distance. With prefix set,
+    // entries are term prefixes, each standing for every term below it,
+    // and only the shortest of nested matches is kept; otherwise they are
+    // whole terms, more frequent first among equal distances.
+    std::vector<std::string> nearest(std::string_view word, bool prefix, std::size_t max_distance, std::size_t limit) const;
+
+private:
+    struct match
+    {
+        std::size_t first = 0U;
+        std::size_t last = 0U;
+        std::size_t depth = 0U;
+        std::size_t distance = 0U;
+    };
+
+    void walk(std::size_t first,
+              std::size_t last,
+              std::size_t depth,
+              std::string_view word,
+              bool prefix,
+              std::size_t max_distance,
+              std::vector<std::size_t> &rows,
+              std::vector<match> &matches) const;
+
+    std::string text_;
+    std::vector<std::uint32_t> offsets_;
+    std::vector<std::uint32_t> doc_freqs_;
+};
+}
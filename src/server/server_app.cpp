@@ -1,7 +1,8 @@
 #include "config/app_config.h"
-#include "index/sqlite_database.h"
 #include "search/query_service.h"
+#include "search/shard_set.h"
 #include "util/json.h"
+#include "util/text_normalizer.h"
 
 #include <arpa/inet.h>
 #include <netdb.h>
@@ -17,6 +18,7 @@
 #include <map>
 #include <memory>
 #include <optional>
+#include <span>
 #include <sstream>
 #include <stdexcept>
 #include <string>
@@ -38,11 +40,20 @@ struct http_request
 
 struct meta_runtime
 {
-    std::unique_ptr<sqlite_database> database;
-    std::unique_ptr<query_service> queries;
+    std::unique_ptr<shard_set> index;
     meta_info meta;
 };
 
+// A search with fewer hits than this carries a "did you mean" suggestion when
+// the spelling index has one.
+constexpr std::size_t suggest_below_hits = 3U;
+
+// tiered=1 keeps title ranking only when the weakest hit of its first page
+// scores at least this much title bm25 (scores are negated). FTS5 floors the
+// idf of a term found in over half the titles near zero, and such a page says
+// little about the query.
+constexpr double tiered_min_title_score = 0.5;
+
 std::pair<std::string, std::string> split_listen_address(const std::string &address) {
     const auto pos = address.rfind(':');
     if (pos == std::string::npos) {
@@ -267,60 +278,179 @@ std::unordered_map<std::string, std::string> parse_query_map(const std::string &
     return map;
 }
 
-bool contains_fts_operator(const std::string &value) {
-    if (value.find('"') != std::string::npos || value.find(':') != std::string::npos) {
-        return true;
+// One double-quoted string without spaces, e.g. "log-quick".
+bool is_quoted_fragment(const std::string &value) {
+    return value.size() > 2U && value.front() == '"' && value.back() == '"' &&
+           value.find_first_of("\" \t", 1U) == value.size() - 1U;
+}
+
+std::string build_response_body(std::span<const std::string> hits_json,
+                                const meta_info &meta,
+                                const std::optional<std::string> &suggest = std::nullopt,
+                                const std::optional<std::string> &facets = std::nullopt) {
+    std::ostringstream oss;
+    oss << "{\"hits\":[";
+    for (std::size_t i = 0U; i < hits_json.size(); ++i) {
+        if (i > 0U) {
+            oss << ',';
+        }
+        oss << hits_json[i];
+    }
+    oss << "],\"count\":" << hits_json.size();
+    if (facets.has_value()) {
+        oss << ",\"facets\":" << *facets;
+    }
+    if (suggest.has_value()) {
+        oss << ",\"suggest\":\"" << json_escape(*suggest) << '\"';
+    }
+    oss << ",\"repo_commit\":\"" << json_escape(meta.repo_commit) << '\"'
+        << '}';
+    return oss.str();
+}
+
+std::string build_response_body(const std::vector<search_hit> &hits,
+                                const meta_info &meta,
+                                const std::optional<std::string> &suggest = std::nullopt,
+                                const std::optional<std::string> &facets = std::nullopt) {
+    std::vector<std::string> hits_json;
+    hits_json.reserve(hits.size());
+    for (const auto &hit : hits) {
+        hits_json.push_back(to_json(hit));
     }
-    std::string lower = value;
-    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char ch) { return static_cast<char>(std::tolower(ch)); });
-    return lower.find(" near") != std::string::npos || lower.find(" not") != std::string::npos || lower.find(" or") != std::string::npos || lower.find(" and") != std::string::npos;
+    return build_response_body(hits_json, meta, suggest, facets);
 }
 
-std::string make_prefix_query(const std::string &original) {
-    if (contains_fts_operator(original)) {
-        return original;
+// A planned query that is one 2- or 3-character prefix term may have its
+// page precomputed by the writer. The stored list holds the top
+// hot_prefix_hits hits, so it answers any page inside that window, and any
+// page at all when the prefix has fewer hits than that.
+std::optional<std::string> hot_prefix_body(const meta_runtime &runtime,
+                                           const std::string &search_query,
+                                           std::size_t limit,
+                                           std::size_t offset) {
+    if (runtime.meta.hot_prefix_hits == 0U || search_query.size() < 2U || search_query.back() != '*') {
+        return std::nullopt;
+    }
+    std::string prefix = search_query.substr(0U, search_query.size() - 1U);
+    const auto length = utf8_length(prefix);
+    if (length < 2U || length > 3U || prefix.find_first_of(" \t*") != std::string::npos) {
+        return std::nullopt;
+    }
+    std::transform(prefix.begin(), prefix.end(), prefix.begin(), [](unsigned char ch) { return static_cast<char>(std::tolower(ch)); });
+    const auto *hits = runtime.index->hot_hits(prefix);
+    if (hits == nullptr || (offset + limit > hits->size() && hits->size() >= runtime.meta.hot_prefix_hits)) {
+        return std::nullopt;
+    }
+    const std::span<const std::string> all{*hits};
+    const auto begin = std::min(offset, all.size());
+    return build_response_body(all.subspan(begin, std::min(limit, all.size() - begin)), runtime.meta);
+}
+
+// Only queries of plain words are corrected; phrases and operators say the
+// user means exactly what they typed.
+bool is_plain_word_query(const std::string &query) {
+    if (query.find('"') != std::string::npos) {
+        return false;
+    }
+    std::istringstream raw{query};
+    std::string word;
+    while (raw >> word) {
+        if (word == "AND" || word == "OR" || word == "NOT") {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Whether the vocabulary has a normalized query word, judged the way
+// make_match_expression matches it: as a prefix, or whole when it is shorter
+// than the smallest prefix index.
+bool is_known_word(const std::string &word, const term_dictionary &dictionary, const meta_runtime &runtime, bool &prefix) {
+    const std::size_t min_prefix = runtime.meta.prefix_index.empty() ? 0U : runtime.meta.prefix_index.front();
+    prefix = utf8_length(word) >= min_prefix;
+    return prefix ? dictionary.has_prefix(word) : dictionary.contains(word);
+}
+
+// Byte edits are only meaningful on ASCII words, and too coarse below three
+// bytes.
+bool is_correctable(const std::string &word) {
+    return word.size() >= 3U && std::all_of(word.begin(), word.end(), [](unsigned char ch) { return ch < 0x80U; });
+}
+
+// Rewrites a plain word query for a second try when it found nothing: every
+// word the vocabulary does not know is replaced by the closest known ones,
+// at most one byte edit away for words of up to 5 bytes and two beyond.
+// A prefix word is corrected to prefixes and a whole word to whole terms.
+// nullopt means a word is too short or too far from anything to correct, or
+// there was nothing to correct.
+std::optional<std::string> make_fuzzy_expression(const std::string &query, const meta_runtime &runtime) {
+    const auto *dictionary = runtime.index->dictionary();
+    if (dictionary == nullptr || dictionary->empty() || !is_plain_word_query(query)) {
+        return std::nullopt;
     }
-    std::istringstream stream{original};
-    std::ostringstream result;
-    std::string token;
-    bool first = true;
-    while (stream >> token) {
-        if (!first) {
-            result << ' ';
+    std::istringstream words{normalize_text(query)};
+    std::string expression;
+    bool corrected = false;
+    std::string word;
+    while (words >> word) {
+        bool prefix = false;
+        std::string term;
+        if (is_known_word(word, *dictionary, runtime, prefix)) {
+            term = prefix ? word + '*' : word;
         }
-        first = false;
-        if (!token.empty() && token.back() != '*') {
-            result << token << '*';
-        } else {
-            result << token;
+        else {
+            if (!is_correctable(word)) {
+                return std::nullopt;
+            }
+            const auto alternatives = dictionary->nearest(word, prefix, word.size() <= 5U ? 1U : 2U, 8U);
+            if (alternatives.empty()) {
+                return std::nullopt;
+            }
+            for (const auto &alternative : alternatives) {
+                term += (term.empty() ? "" : " OR ") + alternative + (prefix ? "*" : "");
+            }
+            if (alternatives.size() > 1U) {
+                term = '(' + term + ')';
+            }
+            corrected = true;
         }
+        expression += (expression.empty() ? "" : " ") + term;
     }
-    return result.str();
+    if (!corrected) {
+        return std::nullopt;
+    }
+    return expression;
 }
 
-std::string build_response_body(const std::vector<search_hit> &hits, const meta_info &meta) {
-    std::ostringstream oss;
-    oss << "{\"hits\":[";
-    for (std::size_t i = 0U; i < hits.size(); ++i) {
-        if (i > 0U) {
-            oss << ',';
+// The "did you mean" text for a plain word query: the normalized query with
+// every unknown word replaced by its spelling_index correction. nullopt when
+// all words are known or one of them has no correction.
+std::optional<std::string> make_suggestion(const std::string &query, const meta_runtime &runtime) {
+    const auto *dictionary = runtime.index->dictionary();
+    const auto *spelling = runtime.index->spelling();
+    if (dictionary == nullptr || spelling == nullptr || spelling->empty() || !is_plain_word_query(query)) {
+        return std::nullopt;
+    }
+    std::istringstream words{normalize_text(query)};
+    std::string suggestion;
+    bool corrected = false;
+    std::string word;
+    while (words >> word) {
+        bool prefix = false;
+        if (!is_known_word(word, *dictionary, runtime, prefix)) {
+            const auto correction = is_correctable(word) ? spelling->correct(word, *dictionary) : std::nullopt;
+            if (!correction.has_value()) {
+                return std::nullopt;
+            }
+            word = *correction;
+            corrected = true;
         }
-        const auto &hit = hits[i];
-        oss << '{'
-            << "\"url\":\"" << json_escape(hit.url) << '\"'
-            << ",\"title\":\"" << json_escape(hit.title) << '\"'
-            << ",\"format\":\"" << json_escape(hit.format) << '\"'
-            << ",\"tags\":" << hit.tags_json
-            << ",\"lang\":\"" << json_escape(hit.lang) << '\"'
-            << ",\"updated_at\":" << hit.updated_at
-            << ",\"score\":" << hit.score
-            << ",\"snippet\":\"" << json_escape(hit.snippet) << '\"'
-            << '}';
-    }
-    oss << "],\"count\":" << hits.size()
-        << ",\"repo_commit\":\"" << json_escape(meta.repo_commit) << '\"'
-        << '}';
-    return oss.str();
+        suggestion += (suggestion.empty() ? "" : " ") + word;
+    }
+    if (!corrected) {
+        return std::nullopt;
+    }
+    return suggestion;
 }
 
 std::string build_meta_body(const meta_info &meta) {
@@ -397,12 +527,85 @@ bool verify_admin(const serve_config &config, const http_request &request) {
 
 meta_runtime open_runtime(const serve_config &config) {
     meta_runtime data;
-    data.database = std::make_unique<sqlite_database>(config.index_path, SQLITE_OPEN_READONLY);
-    data.queries = std::make_unique<query_service>(*data.database);
-    data.meta = data.queries->load_meta();
+    data.index = std::make_unique<shard_set>(config.index_path, config.engine, config.ranking);
+    data.meta = data.index->load_meta();
     return data;
 }
 
+// Comma-separated items with surrounding spaces trimmed; empty ones dropped.
+std::vector<std::string> split_list(const std::string &value) {
+    std::vector<std::string> items;
+    std::size_t start = 0U;
+    while (start <= value.size()) {
+        const auto comma = std::min(value.find(',', start), value.size());
+        const auto item = value.substr(start, comma - start);
+        const auto first = item.find_first_not_of(' ');
+        if (first != std::string::npos) {
+            items.push_back(item.substr(first, item.find_last_not_of(' ') - first + 1U));
+        }
+        start = comma + 1U;
+    }
+    return items;
+}
+
+// tag=a,b requires every listed tag; lang= and format= one value each.
+search_filter parse_filter(const std::unordered_map<std::string, std::string> &params) {
+    search_filter filter;
+    const auto it_tag = params.find("tag");
+    if (it_tag != params.end()) {
+        filter.tags = split_list(it_tag->second);
+    }
+    const auto it_lang = params.find("lang");
+    if (it_lang != params.end()) {
+        filter.lang = it_lang->second;
+    }
+    const auto it_format = params.find("format");
+    if (it_format != params.end()) {
+        filter.format = it_format->second;
+    }
+    return filter;
+}
+
+// facets=tags,lang,format in any order and subset; nullopt when a name is
+// not one of those.
+std::optional<std::vector<std::string>> parse_facets(const std::unordered_map<std::string, std::string> &params) {
+    std::vector<std::string> names;
+    const auto it_facets = params.find("facets");
+    if (it_facets == params.end()) {
+        return names;
+    }
+    for (auto &name : split_list(it_facets->second)) {
+        if (name != "tags" && name != "lang" && name != "format") {
+            return std::nullopt;
+        }
+        if (std::find(names.begin(), names.end(), name) == names.end()) {
+            names.push_back(std::move(name));
+        }
+    }
+    return names;
+}
+
+// {"tags":[{"value":"ops","count":12},...],...} in the requested order.
+std::string facets_json(const std::vector<std::string> &names, const std::vector<std::vector<facet_count>> &counts) {
+    std::ostringstream oss;
+    oss << '{';
+    for (std::size_t k = 0U; k < names.size(); ++k) {
+        if (k > 0U) {
+            oss << ',';
+        }
+        oss << '\"' << names[k] << "\":[";
+        for (std::size_t i = 0U; i < counts[k].size(); ++i) {
+            if (i > 0U) {
+                oss << ',';
+            }
+            oss << "{\"value\":\"" << json_escape(counts[k][i].value) << "\",\"count\":" << counts[k][i].count << '}';
+        }
+        oss << ']';
+    }
+    oss << '}';
+    return oss.str();
+}
+
 void handle_search(int fd,
                    const serve_config &config,
                    meta_runtime &runtime,
@@ -458,25 +661,206 @@ void handle_search(int fd,
         }
     }
 
-    const auto search_query = make_prefix_query(query);
+    const auto filter = parse_filter(params);
+    if (!filter.empty() && !runtime.index->has_facets()) {
+        send_response(fd, 400, {{"Content-Type", "application/json"}}, "{\"error\":\"filters are not available for this index\"}");
+        return;
+    }
+    const auto facet_names = parse_facets(params);
+    if (!facet_names.has_value()) {
+        send_response(fd, 400, {{"Content-Type", "application/json"}}, "{\"error\":\"unknown facet\"}");
+        return;
+    }
+    if (!facet_names->empty() && !runtime.index->has_facets()) {
+        send_response(fd, 400, {{"Content-Type", "application/json"}}, "{\"error\":\"facets are not available for this index\"}");
+        return;
+    }
+    std::vector<std::string> facet_kinds;
+    for (const auto &name : *facet_names) {
+        facet_kinds.push_back(name == "tags" ? "tag" : name);
+    }
+
+    // substr=1, or a quoted fragment on an index with a trigram table, looks
+    // the text up as a substring instead of as words.
+    const auto it_substr = params.find("substr");
+    const bool quoted = is_quoted_fragment(query);
+    const bool substring = (it_substr != params.end() && it_substr->second == "1") || (quoted && runtime.meta.trigram);
+    std::string search_query;
+    if (substring) {
+        if (!runtime.meta.trigram) {
+            send_response(fd, 400, {{"Content-Type", "application/json"}}, "{\"error\":\"substring search is not enabled for this index\"}");
+            return;
+        }
+        search_query = quoted ? query.substr(1U, query.size() - 2U) : query;
+        if (utf8_length(search_query) < 3U) {
+            send_response(fd, 400, {{"Content-Type", "application/json"}}, "{\"error\":\"substring query too short\"}");
+            return;
+        }
+    }
+    else {
+        // With FTS5 prefix indexes, a word shorter than the shortest indexed
+        // length is matched whole: no index covers it, and its expansion
+        // would scan a large slice of the vocabulary.
+        // With --prefix-fanout, SQLite gets the same cap as the memory
+        // engine: a prefix expanding to more terms than that is replaced by
+        // its most frequent ones, looked up in the dictionary.
+        const auto *dictionary = runtime.index->dictionary();
+        prefix_cap cap;
+        if (config.engine == search_engine::sqlite && runtime.meta.prefix_fanout > 0U && dictionary != nullptr &&
+            !dictionary->empty()) {
+            cap = [dictionary, fanout = runtime.meta.prefix_fanout](std::string_view prefix) {
+                return dictionary->top_expansions(prefix, fanout);
+            };
+        }
+        search_query = make_match_expression(query, runtime.meta.prefix_index, cap);
+        if (search_query.empty()) {
+            std::optional<std::string> facets;
+            if (!facet_names->empty()) {
+                facets = facets_json(*facet_names, std::vector<std::vector<facet_count>>(facet_names->size()));
+            }
+            send_response(fd,
+                          200,
+                          {{"Content-Type", "application/json"}, {"Cache-Control", "no-store"}, {"X-Index-Version", runtime.meta.repo_commit}},
+                          build_response_body(std::vector<search_hit>{}, runtime.meta, std::nullopt, facets));
+            return;
+        }
+        if (!runtime.index->supports_query(search_query)) {
+            send_response(fd, 400, {{"Content-Type", "application/json"}}, "{\"error\":\"unsupported query syntax for segment indexes\"}");
+            return;
+        }
+        const bool plain = filter.empty() && facet_names->empty();
+        const auto hot_body = plain ? hot_prefix_body(runtime, search_query, limit, offset) : std::nullopt;
+        if (hot_body.has_value()) {
+            send_response(fd,
+                          200,
+                          {{"Content-Type", "application/json"}, {"Cache-Control", "no-store"}, {"X-Index-Version", runtime.meta.repo_commit}},
+                          *hot_body);
+            return;
+        }
+    }
 
+    // tiered=1 picks one ranking per query from the first page of title
+    // matches: when it is full and its weakest hit clears
+    // tiered_min_title_score, every page comes from the title index, so
+    // paging never switches rankings; otherwise every page uses the full
+    // search. Indexes without a title table go straight to the full search.
+    const auto it_tiered = params.find("tiered");
+    bool tiered = it_tiered != params.end() && it_tiered->second == "1" && !substring && runtime.index->has_title_index();
     std::vector<search_hit> hits;
+    // Facets count the matches of whichever query and mode produced the hits.
+    auto matched_mode = substring ? match_mode::substring : match_mode::words;
     try {
-        hits = runtime.queries->search(search_query.empty() ? query : search_query, limit, offset);
+        if (tiered) {
+            hits = runtime.index->search(search_query, limit, 0U, match_mode::titles, filter);
+            tiered = limit > 0U && hits.size() == limit && -hits.back().score >= tiered_min_title_score;
+            if (tiered) {
+                matched_mode = match_mode::titles;
+            }
+            if (tiered && offset > 0U) {
+                hits = runtime.index->search(search_query, limit, offset, matched_mode, filter);
+            }
+        }
+        if (!tiered) {
+            hits = runtime.index->search(search_query, limit, offset, matched_mode, filter);
+        }
     }
     catch (const std::exception &ex) {
         send_response(fd, 500, {{"Content-Type", "application/json"}}, "{\"error\":\"search failed\"}");
         std::cerr << "search error: " << ex.what() << '\n';
         return;
     }
+    std::optional<std::string> suggest;
+    if (hits.size() < suggest_below_hits && !substring) {
+        suggest = make_suggestion(query, runtime);
+    }
+    auto matched_query = search_query;
+    if (hits.empty() && !substring) {
+        const auto fuzzy_query = make_fuzzy_expression(query, runtime);
+        if (fuzzy_query.has_value()) {
+            try {
+                hits = runtime.index->search(*fuzzy_query, limit, offset, match_mode::words, filter);
+                if (!hits.empty()) {
+                    matched_query = *fuzzy_query;
+                    matched_mode = match_mode::words;
+                }
+            }
+            catch (const std::exception &ex) {
+                std::cerr << "fuzzy search error: " << ex.what() << '\n';
+            }
+        }
+    }
+    std::optional<std::string> facets;
+    if (!facet_names->empty()) {
+        try {
+            facets = facets_json(*facet_names,
+                                 runtime.index->facet_counts(matched_query, matched_mode, filter, facet_kinds));
+        }
+        catch (const std::exception &ex) {
+            send_response(fd, 500, {{"Content-Type", "application/json"}}, "{\"error\":\"search failed\"}");
+            std::cerr << "facet error: " << ex.what() << '\n';
+            return;
+        }
+    }
 
-    const auto body = build_response_body(hits, runtime.meta);
+    const auto body = build_response_body(hits, runtime.meta, suggest, facets);
     send_response(fd,
                   200,
                   {{"Content-Type", "application/json"}, {"Cache-Control", "no-store"}, {"X-Index-Version", runtime.meta.repo_commit}},
                   body);
 }
 
+// Completes the last word of q from the in-memory completion index, without
+// touching SQLite. Each completion is the normalized query with that word
+// completed; a query ending in whitespace has no word left to complete.
+void handle_suggest(int fd, const meta_runtime &runtime, const std::unordered_map<std::string, std::string> &params) {
+    const auto it_query = params.find("q");
+    if (it_query == params.end()) {
+        send_response(fd, 400, {{"Content-Type", "application/json"}}, "{\"error\":\"missing q\"}");
+        return;
+    }
+    const auto *completions = runtime.index->completions();
+    if (completions == nullptr || completions->empty()) {
+        send_response(fd, 400, {{"Content-Type", "application/json"}}, "{\"error\":\"completions are not available for this index\"}");
+        return;
+    }
+
+    std::size_t limit = 8U;
+    const auto it_limit = params.find("limit");
+    if (it_limit != params.end()) {
+        try {
+            limit = static_cast<std::size_t>(std::stoul(it_limit->second));
+        }
+        catch (...) {
+            limit = 8U;
+        }
+    }
+    limit = std::clamp<std::size_t>(limit, 1U, max_completions);
+
+    const auto &query = it_query->second;
+    const auto normalized = normalize_text(query);
+    std::vector<std::string> texts;
+    if (!normalized.empty() && !std::isspace(static_cast<unsigned char>(query.back()))) {
+        const auto space = normalized.rfind(' ');
+        const auto head = space == std::string::npos ? std::string{} : normalized.substr(0U, space + 1U);
+        for (const auto &word : completions->complete(normalized.substr(head.size()), limit)) {
+            texts.push_back(head + word);
+        }
+    }
+
+    std::ostringstream oss;
+    oss << "{\"completions\":[";
+    for (std::size_t i = 0U; i < texts.size(); ++i) {
+        oss << (i > 0U ? "," : "") << '\"' << json_escape(texts[i]) << '\"';
+    }
+    oss << "],\"count\":" << texts.size()
+        << ",\"repo_commit\":\"" << json_escape(runtime.meta.repo_commit) << '\"'
+        << '}';
+    send_response(fd,
+                  200,
+                  {{"Content-Type", "application/json"}, {"Cache-Control", "no-store"}, {"X-Index-Version", runtime.meta.repo_commit}},
+                  oss.str());
+}
+
 void handle_meta(int fd, const meta_runtime &runtime) {
     const auto body = build_meta_body(runtime.meta);
     send_response(fd,
@@ -520,6 +904,11 @@ void route_request(int fd, const serve_config &config, meta_runtime &runtime, co
         return;
     }
 
+    if (request.method == "GET" && request.target_path == "/suggest") {
+        handle_suggest(fd, runtime, parse_query_map(request.query_string));
+        return;
+    }
+
     if (request.method == "GET" && request.target_path == "/meta") {
         handle_meta(fd, runtime);
         return;
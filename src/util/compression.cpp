@@ -0,0 +1,50 @@
+#include "compression.h"
+
+#include <zlib.h>
+
+#include <cstdint>
+#include <stdexcept>
+
+namespace retort
+{
+// Blob layout: 4-byte little-endian uncompressed size followed by a zlib
+// stream, so inflate can size its buffer up front.
+std::string deflate_text(std::string_view text) {
+    const auto source_size = static_cast<uLong>(text.size());
+    uLongf bound = compressBound(source_size);
+    std::string blob(4U + bound, '\0');
+    for (int i = 0; i < 4; ++i) {
+        blob[static_cast<std::size_t>(i)] = static_cast<char>((source_size >> (i * 8)) & 0xFFU);
+    }
+    const int rc = compress2(reinterpret_cast<Bytef *>(blob.data() + 4),
+                             &bound,
+                             reinterpret_cast<const Bytef *>(text.data()),
+                             source_size,
+                             Z_DEFAULT_COMPRESSION);
+    if (rc != Z_OK) {
+        throw std::runtime_error("failed to compress text");
+    }
+    blob.resize(4U + bound);
+    return blob;
+}
+
+std::string inflate_text(std::string_view blob) {
+    if (blob.size() < 4U) {
+        throw std::runtime_error("compressed blob is truncated");
+    }
+    std::uint32_t size = 0U;
+    for (int i = 0; i < 4; ++i) {
+        size |= static_cast<std::uint32_t>(static_cast<unsigned char>(blob[static_cast<std::size_t>(i)])) << (i * 8);
+    }
+    std::string text(size, '\0');
+    uLongf text_size = size;
+    const int rc = uncompress(reinterpret_cast<Bytef *>(text.data()),
+                              &text_size,
+                              reinterpret_cast<const Bytef *>(blob.data() + 4),
+                              static_cast<uLong>(blob.size() - 4U));
+    if (rc != Z_OK || text_size != size) {
+        throw std::runtime_error("failed to decompress text");
+    }
+    return text;
+}
+}
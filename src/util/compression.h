@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace retort
+{
+std::string deflate_text(std::string_view text);
+std::string inflate_text(std::string_view blob);
+}
@@ -0,0 +1,239 @@
+#include "sha1.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define RETORT_SHA1_X86 1
+#endif
+
+namespace retort
+{
+namespace
+{
+constexpr std::array<std::uint32_t, 5> initial_state{0x67452301U, 0xEFCDAB89U, 0x98BADCFEU, 0x10325476U, 0xC3D2E1F0U};
+
+constexpr std::uint32_t rotl(std::uint32_t value, int bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+std::uint32_t load_be32(const std::uint8_t *data) {
+    return (static_cast<std::uint32_t>(data[0]) << 24) | (static_cast<std::uint32_t>(data[1]) << 16) |
+           (static_cast<std::uint32_t>(data[2]) << 8) | static_cast<std::uint32_t>(data[3]);
+}
+
+void compress_scalar(std::uint32_t *state, const std::uint8_t *data, std::size_t blocks) {
+    std::uint32_t w[80];
+    for (; blocks > 0U; --blocks, data += 64) {
+        for (int i = 0; i < 16; ++i) {
+            w[i] = load_be32(data + i * 4);
+        }
+        for (int i = 16; i < 80; ++i) {
+            w[i] = rotl(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        std::uint32_t a = state[0];
+        std::uint32_t b = state[1];
+        std::uint32_t c = state[2];
+        std::uint32_t d = state[3];
+        std::uint32_t e = state[4];
+        for (int i = 0; i < 80; ++i) {
+            std::uint32_t f = 0U;
+            std::uint32_t k = 0U;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999U;
+            }
+            else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1U;
+            }
+            else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDCU;
+            }
+            else {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6U;
+            }
+            const std::uint32_t temp = rotl(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotl(b, 30);
+            b = a;
+            a = temp;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+}
+
+#if defined(RETORT_SHA1_X86)
+// SHA-NI path: each sha1rnds4 covers four rounds, so one block is twenty
+// groups. The round function selector changes every five groups.
+__attribute__((target("sha,sse4.1"))) __m128i sha_rounds(__m128i abcd, __m128i e, int group) {
+    switch (group / 5) {
+    case 0:
+        return _mm_sha1rnds4_epu32(abcd, e, 0);
+    case 1:
+        return _mm_sha1rnds4_epu32(abcd, e, 1);
+    case 2:
+        return _mm_sha1rnds4_epu32(abcd, e, 2);
+    default:
+        return _mm_sha1rnds4_epu32(abcd, e, 3);
+    }
+}
+
+__attribute__((target("sha,sse4.1"))) void compress_sha_ni(std::uint32_t *state, const std::uint8_t *data, std::size_t blocks) {
+    const __m128i byte_swap = _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(state)), 0x1B);
+    __m128i e = _mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0);
+
+    for (; blocks > 0U; --blocks, data += 64) {
+        const __m128i abcd_save = abcd;
+        const __m128i e_save = e;
+        __m128i w[4];
+        for (int i = 0; i < 4; ++i) {
+            w[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i * 16)), byte_swap);
+        }
+        for (int group = 0; group < 20; ++group) {
+            auto &current = w[group % 4];
+            if (group >= 4) {
+                current = _mm_sha1msg1_epu32(current, w[(group + 1) % 4]);
+                current = _mm_xor_si128(current, w[(group + 2) % 4]);
+                current = _mm_sha1msg2_epu32(current, w[(group + 3) % 4]);
+            }
+            const __m128i e_in = group == 0 ? _mm_add_epi32(e, current) : _mm_sha1nexte_epu32(e, current);
+            e = abcd;
+            abcd = sha_rounds(abcd, e_in, group);
+        }
+        e = _mm_sha1nexte_epu32(e, e_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(state), _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = static_cast<std::uint32_t>(_mm_extract_epi32(e, 3));
+}
+
+bool cpu_has_sha_ni() {
+    unsigned int eax = 0U;
+    unsigned int ebx = 0U;
+    unsigned int ecx = 0U;
+    unsigned int edx = 0U;
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) == 0) {
+        return false;
+    }
+    const bool has_sha = (ebx & (1U << 29)) != 0U;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0) {
+        return false;
+    }
+    const bool has_sse41 = (ecx & (1U << 19)) != 0U;
+    return has_sha && has_sse41;
+}
+#endif
+
+using compress_fn = void (*)(std::uint32_t *, const std::uint8_t *, std::size_t);
+
+compress_fn select_compress() {
+#if defined(RETORT_SHA1_X86)
+    if (cpu_has_sha_ni()) {
+        return compress_sha_ni;
+    }
+#endif
+    return compress_scalar;
+}
+
+const compress_fn compress = select_compress();
+}
+
+sha1_hasher::sha1_hasher() noexcept
+    : state_{initial_state}
+{
+}
+
+void sha1_hasher::update(const void *data, std::size_t size) noexcept
+{
+    const auto *bytes = static_cast<const std::uint8_t *>(data);
+    total_bytes_ += size;
+
+    if (buffered_ > 0U) {
+        const std::size_t take = std::min(size, buffer_.size() - buffered_);
+        std::memcpy(buffer_.data() + buffered_, bytes, take);
+        buffered_ += take;
+        bytes += take;
+        size -= take;
+        if (buffered_ < buffer_.size()) {
+            return;
+        }
+        compress(state_.data(), buffer_.data(), 1U);
+        buffered_ = 0U;
+    }
+
+    const std::size_t blocks = size / 64U;
+    if (blocks > 0U) {
+        compress(state_.data(), bytes, blocks);
+        bytes += blocks * 64U;
+        size -= blocks * 64U;
+    }
+
+    if (size > 0U) {
+        std::memcpy(buffer_.data(), bytes, size);
+        buffered_ = size;
+    }
+}
+
+void sha1_hasher::update(std::string_view data) noexcept
+{
+    update(data.data(), data.size());
+}
+
+sha1_hasher::digest sha1_hasher::finish() noexcept
+{
+    const std::uint64_t bit_length = total_bytes_ * 8U;
+    buffer_[buffered_++] = 0x80U;
+    if (buffered_ > 56U) {
+        std::memset(buffer_.data() + buffered_, 0, buffer_.size() - buffered_);
+        compress(state_.data(), buffer_.data(), 1U);
+        buffered_ = 0U;
+    }
+    std::memset(buffer_.data() + buffered_, 0, 56U - buffered_);
+    for (int i = 0; i < 8; ++i) {
+        buffer_[63 - i] = static_cast<std::uint8_t>(bit_length >> (i * 8));
+    }
+    compress(state_.data(), buffer_.data(), 1U);
+
+    digest result{};
+    for (std::size_t i = 0U; i < state_.size(); ++i) {
+        result[i * 4U] = static_cast<std::uint8_t>(state_[i] >> 24);
+        result[i * 4U + 1U] = static_cast<std::uint8_t>(state_[i] >> 16);
+        result[i * 4U + 2U] = static_cast<std::uint8_t>(state_[i] >> 8);
+        result[i * 4U + 3U] = static_cast<std::uint8_t>(state_[i]);
+    }
+
+    state_ = initial_state;
+    buffered_ = 0U;
+    total_bytes_ = 0U;
+    return result;
+}
+
+std::string sha1_hasher::finish_hex()
+{
+    return to_hex(finish());
+}
+
+std::string to_hex(const sha1_hasher::digest &value) {
+    static constexpr char digits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(value.size() * 2U);
+    for (const auto byte : value) {
+        hex.push_back(digits[byte >> 4]);
+        hex.push_back(digits[byte & 0x0FU]);
+    }
+    return hex;
+}
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace retort
+{
+class sha1_hasher
+{
+public:
+    using digest = std::array<std::uint8_t, 20>;
+
+    sha1_hasher() noexcept;
+
+    void update(const void *data, std::size_t size) noexcept;
+    void update(std::string_view data) noexcept;
+
+    digest finish() noexcept;
+    std::string finish_hex();
+
+private:
+    std::array<std::uint32_t, 5> state_{};
+    std::array<std::uint8_t, 64> buffer_{};
+    std::size_t buffered_ = 0U;
+    std::uint64_t total_bytes_ = 0U;
+};
+
+std::string to_hex(const sha1_hasher::digest &value);
+}
@@ -0,0 +1,180 @@
+#include "text_normalizer.h"
+
+#include <algorithm>
+#include <cctype>
+#include <utility>
+
+namespace retort
+{
+namespace
+{
+bool is_operator(std::string_view word) {
+    return word == "AND" || word == "OR" || word == "NOT";
+}
+
+// ("a" OR "b" ...), quoted since vocabulary terms need not be barewords.
+std::string any_of_terms(const std::vector<std::string_view> &terms) {
+    std::string group{"("};
+    for (const auto term : terms) {
+        if (group.size() > 1U) {
+            group += " OR ";
+        }
+        group.push_back('"');
+        for (const char ch : term) {
+            group.push_back(ch);
+            if (ch == '"') {
+                group.push_back('"');
+            }
+        }
+        group.push_back('"');
+    }
+    group.push_back(')');
+    return group;
+}
+
+// Joins terms, keeping an operator only between two of them. FTS5 has no
+// implicit AND next to a parenthesized group, so one is written out there.
+class expression_builder
+{
+public:
+    void add_term(std::string_view term, bool group = false) {
+        if (!expression_.empty()) {
+            if (!pending_.empty()) {
+                expression_.append(" " + pending_ + " ");
+            }
+            else {
+                expression_.append(group || last_group_ ? " AND " : " ");
+            }
+        }
+        expression_.append(term);
+        pending_.clear();
+        last_group_ = group;
+    }
+
+    void add_operator(std::string_view op) {
+        if (!expression_.empty() && pending_.empty()) {
+            pending_ = op;
+        }
+    }
+
+    std::string take() {
+        return std::move(expression_);
+    }
+
+private:
+    std::string expression_;
+    std::string pending_;
+    bool last_group_ = false;
+};
+}
+
+std::size_t utf8_length(std::string_view text) {
+    return static_cast<std::size_t>(std::count_if(text.begin(), text.end(), [](char ch) {
+        return (static_cast<unsigned char>(ch) & 0xC0U) != 0x80U;
+    }));
+}
+
+std::string collapse_punctuation(std::string_view input) {
+    std::string output;
+    output.reserve(input.size());
+    bool last_space = false;
+    for (unsigned char uc : input) {
+        if (std::isalnum(uc)) {
+            output.push_back(static_cast<char>(std::tolower(uc)));
+            last_space = false;
+        }
+        else if (static_cast<unsigned char>(uc) >= 128U) {
+            output.push_back(static_cast<char>(uc));
+            last_space = false;
+        }
+        else {
+            if (!last_space) {
+                output.push_back(' ');
+                last_space = true;
+            }
+        }
+    }
+    return output;
+}
+
+std::string collapse_spaces(std::string_view input) {
+    std::string output;
+    output.reserve(input.size());
+    bool last_space = true;
+    for (char ch : input) {
+        if (std::isspace(static_cast<unsigned char>(ch))) {
+            if (!last_space) {
+                output.push_back(' ');
+                last_space = true;
+            }
+        }
+        else {
+            output.push_back(ch);
+            last_space = false;
+        }
+    }
+    if (!output.empty() && output.back() == ' ') {
+        output.pop_back();
+    }
+    return output;
+}
+
+std::string normalize_text(std::string_view input) {
+    return collapse_spaces(collapse_punctuation(input));
+}
+
+// Normalized text only holds [a-z0-9], spaces and bytes >= 0x80, so every
+// word of it is an FTS5 bareword and no keyword, and a quoted phrase of it
+// needs no escaping.
+std::string make_match_expression(std::string_view query, const std::vector<std::size_t> &prefix_index, const prefix_cap &cap) {
+    const std::size_t min_prefix = prefix_index.empty() ? 0U : prefix_index.front();
+    expression_builder builder;
+    std::size_t pos = 0U;
+    while (pos < query.size()) {
+        if (std::isspace(static_cast<unsigned char>(query[pos]))) {
+            ++pos;
+            continue;
+        }
+        if (query[pos] == '"') {
+            const auto close = query.find('"', pos + 1U);
+            const auto content = query.substr(pos + 1U, close == std::string_view::npos ? std::string_view::npos : close - pos - 1U);
+            pos = close == std::string_view::npos ? query.size() : close + 1U;
+            const auto phrase = normalize_text(content);
+            if (!phrase.empty()) {
+                builder.add_term('"' + phrase + (close == std::string_view::npos ? "\"*" : "\""));
+            }
+            continue;
+        }
+        auto end = pos;
+        while (end < query.size() && query[end] != '"' && !std::isspace(static_cast<unsigned char>(query[end]))) {
+            ++end;
+        }
+        const auto word = query.substr(pos, end - pos);
+        pos = end;
+        if (is_operator(word)) {
+            builder.add_operator(word);
+            continue;
+        }
+        const auto normalized = normalize_text(word);
+        std::size_t begin = 0U;
+        while (begin < normalized.size()) {
+            const auto space = std::min(normalized.find(' ', begin), normalized.size());
+            const auto term = std::string_view{normalized}.substr(begin, space - begin);
+            if (utf8_length(term) < min_prefix) {
+                builder.add_term(term);
+            }
+            else {
+                const auto capped = cap ? cap(term) : std::vector<std::string_view>{};
+                if (capped.empty()) {
+                    builder.add_term(std::string{term} + '*');
+                }
+                else {
+                    builder.add_term(any_of_terms(capped), true);
+                }
+            }
+            begin = space + 1U;
+        }
+    }
+    return builder.take();
+}
+}
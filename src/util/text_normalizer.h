@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace retort
+{
+// Code points in UTF-8 text, counting every byte that does not continue a
+// sequence.
+std::size_t utf8_length(std::string_view text);
+
+// Lowercases ASCII letters, keeps digits and bytes >= 0x80, and turns every
+// run of other ASCII bytes into one space.
+std::string collapse_punctuation(std::string_view input);
+
+// Squeezes whitespace runs to one space and trims both ends.
+std::string collapse_spaces(std::string_view input);
+
+// The form body text is indexed in: collapse_spaces(collapse_punctuation()).
+std::string normalize_text(std::string_view input);
+
+// Turns arbitrary user input into an FTS5 MATCH expression that always
+// parses. Words are normalized like indexed text, so what is left of them is
+// a plain bareword, and each becomes a prefix term; with prefix_index set, a
+// word shorter than its smallest length is matched whole. A double-quoted
+// span becomes an exact phrase (an unterminated one a prefix phrase), and
+// AND, OR and NOT written in capitals stay operators when a term sits on
+// both sides. Returns "" when nothing searchable is left.
+//
+// cap, when set, is asked for the terms each prefix term should be limited
+// to; a non-empty answer replaces the prefix with an OR of those terms.
+using prefix_cap = std::function<std::vector<std::string_view>(std::string_view prefix)>;
+std::string make_match_expression(std::string_view query,
+                                  const std::vector<std::size_t> &prefix_index,
+                                  const prefix_cap &cap = {});
+}
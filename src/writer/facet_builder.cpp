@@ -0,0 +1,92 @@
+#include "facet_builder.h"
+
+#include "index/doc_bitmap.h"
+
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace retort
+{
+namespace
+{
+void insert_bitmap(sqlite3_stmt *insert, const std::string &kind, const std::string &value, const std::vector<std::uint32_t> &ids) {
+    const auto bytes = doc_bitmap::from_sorted(ids).serialize();
+    sqlite3_reset(insert);
+    sqlite3_bind_text(insert, 1, kind.data(), static_cast<int>(kind.size()), SQLITE_STATIC);
+    sqlite3_bind_text(insert, 2, value.data(), static_cast<int>(value.size()), SQLITE_STATIC);
+    sqlite3_bind_int64(insert, 3, static_cast<sqlite3_int64>(ids.size()));
+    sqlite3_bind_blob(insert, 4, bytes.data(), static_cast<int>(bytes.size()), SQLITE_STATIC);
+    if (sqlite3_step(insert) != SQLITE_DONE) {
+        throw std::runtime_error("failed to insert facet bitmap");
+    }
+}
+}
+
+void write_facet_bitmaps(sqlite_database &database) {
+    auto *db = database.handle();
+    database.exec("DELETE FROM facet_bitmaps;");
+
+    // Sorted by value and rowid, so each value's ids arrive as one sorted run.
+    const char *sql =
+        "SELECT 'tag', j.value, d.id FROM docs d, json_each(d.tags) j"
+        " WHERE json_valid(d.tags) AND j.type = 'text'"
+        " UNION ALL SELECT 'lang', lang, id FROM docs WHERE lang IS NOT NULL AND lang <> ''"
+        " UNION ALL SELECT 'format', format, id FROM docs"
+        " ORDER BY 1, 2, 3";
+    sqlite3_stmt *rows = nullptr;
+    if (sqlite3_prepare_v2(db, sql, -1, &rows, nullptr) != SQLITE_OK) {
+        sqlite3_finalize(rows);
+        throw std::runtime_error("failed to prepare facet scan");
+    }
+    sqlite3_stmt *insert = nullptr;
+    if (sqlite3_prepare_v2(db, "INSERT INTO facet_bitmaps(kind, value, doc_count, bitmap) VALUES(?, ?, ?, ?)", -1, &insert, nullptr) != SQLITE_OK) {
+        sqlite3_finalize(rows);
+        sqlite3_finalize(insert);
+        throw std::runtime_error("failed to prepare facet insert");
+    }
+
+    try {
+        std::string kind;
+        std::string value;
+        std::vector<std::uint32_t> ids;
+        int step = SQLITE_ROW;
+        while ((step = sqlite3_step(rows)) == SQLITE_ROW) {
+            const std::string row_kind = reinterpret_cast<const char *>(sqlite3_column_text(rows, 0));
+            const std::string row_value{reinterpret_cast<const char *>(sqlite3_column_text(rows, 1)),
+                                        static_cast<std::size_t>(sqlite3_column_bytes(rows, 1))};
+            const auto id = sqlite3_column_int64(rows, 2);
+            if (id < 0 || id > std::numeric_limits<std::uint32_t>::max()) {
+                throw std::runtime_error("doc id out of range for facet bitmaps");
+            }
+            if (row_kind != kind || row_value != value) {
+                if (!ids.empty()) {
+                    insert_bitmap(insert, kind, value, ids);
+                }
+                kind = row_kind;
+                value = row_value;
+                ids.clear();
+            }
+            // A tag listed twice in one document repeats its row.
+            if (ids.empty() || ids.back() != static_cast<std::uint32_t>(id)) {
+                ids.push_back(static_cast<std::uint32_t>(id));
+            }
+        }
+        if (step != SQLITE_DONE) {
+            throw std::runtime_error("failed to read facet values");
+        }
+        if (!ids.empty()) {
+            insert_bitmap(insert, kind, value, ids);
+        }
+    }
+    catch (...) {
+        sqlite3_finalize(rows);
+        sqlite3_finalize(insert);
+        throw;
+    }
+    sqlite3_finalize(rows);
+    sqlite3_finalize(insert);
+}
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "index/sqlite_database.h"
+
+namespace retort
+{
+// Replaces the facet_bitmaps rows with one compressed doc bitmap
+// (index/doc_bitmap.h) per tag, lang and format value found in docs. Runs
+// inside the caller's transaction.
+void write_facet_bitmaps(sqlite_database &database);
+}
@@ -0,0 +1,99 @@
+#include "git_history.h"
+
+#include <cstdio>
+#include <string_view>
+
+namespace retort
+{
+namespace
+{
+constexpr char commit_marker = '\x1f';
+
+std::string shell_quote(const std::string &value) {
+    std::string quoted{"'"};
+    for (const char ch : value) {
+        if (ch == '\'') {
+            quoted.append("'\\''");
+        }
+        else {
+            quoted.push_back(ch);
+        }
+    }
+    quoted.push_back('\'');
+    return quoted;
+}
+
+std::filesystem::path normalized_absolute(const std::filesystem::path &path) {
+    std::error_code ec;
+    auto absolute = std::filesystem::absolute(path, ec);
+    if (ec) {
+        absolute = path;
+    }
+    return absolute.lexically_normal();
+}
+}
+
+git_history git_history::load(const std::filesystem::path &repo_root) {
+    git_history history;
+    history.root_ = normalized_absolute(repo_root);
+
+    // Newest commits come first, so the first time a path shows up is its
+    // last change. --relative keeps paths relative to repo_root even when it
+    // is a subdirectory of the work tree.
+    const std::string command = "git -C " + shell_quote(history.root_.string()) +
+                                " -c core.quotepath=off log --name-only --no-renames --relative"
+                                " --format=%x1f%H%x20%ct 2>/dev/null";
+    FILE *pipe = popen(command.c_str(), "r");
+    if (pipe == nullptr) {
+        return history;
+    }
+
+    std::string line;
+    std::int64_t current_time = 0;
+    char buffer[4096];
+    while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
+        line.append(buffer);
+        if (line.empty() || line.back() != '\n') {
+            continue;
+        }
+        line.pop_back();
+        if (!line.empty() && line.front() == commit_marker) {
+            const std::string_view header{line.data() + 1, line.size() - 1U};
+            const auto space = header.find(' ');
+            if (space != std::string_view::npos) {
+                if (!history.head_commit_.has_value()) {
+                    history.head_commit_ = std::string{header.substr(0U, space)};
+                }
+                current_time = std::stoll(std::string{header.substr(space + 1U)});
+            }
+        }
+        else if (!line.empty()) {
+            history.committed_at_.try_emplace(line, current_time);
+        }
+        line.clear();
+    }
+    if (pclose(pipe) != 0) {
+        history.head_commit_.reset();
+        history.committed_at_.clear();
+    }
+    return history;
+}
+
+const std::optional<std::string> &git_history::head_commit() const noexcept
+{
+    return head_commit_;
+}
+
+std::optional<std::int64_t> git_history::committed_at(const std::filesystem::path &file_path) const
+{
+    if (committed_at_.empty()) {
+        return std::nullopt;
+    }
+    const auto relative = normalized_absolute(file_path).lexically_relative(root_).generic_string();
+    const auto it = committed_at_.find(relative);
+    if (it == committed_at_.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+}
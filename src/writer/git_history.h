@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace retort
+{
+// Last-commit times for every file in a repository, collected from a single
+// `git log --name-only` pass instead of one git process per file.
+class git_history
+{
+public:
+    static git_history load(const std::filesystem::path &repo_root);
+
+    const std::optional<std::string> &head_commit() const noexcept;
+    std::optional<std::int64_t> committed_at(const std::filesystem::path &file_path) const;
+
+private:
+    std::filesystem::path root_;
+    std::optional<std::string> head_commit_;
+    std::unordered_map<std::string, std::int64_t> committed_at_;
+};
+}
@@ -1,41 +1,43 @@
 #include "index_builder.h"
 
+#include "index/cjk_tokenizer.h"
 #include "index/document.h"
 #include "index/schema_migration.h"
+#include "index/segment_file.h"
+#include "index/shard_manifest.h"
 #include "index/sqlite_database.h"
+#include "search/memory_index.h"
+#include "util/compression.h"
+#include "writer/facet_builder.h"
+#include "writer/git_history.h"
 #include "writer/markdown_loader.h"
+#include "writer/vocabulary_builder.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <chrono>
-#include <cstdio>
+#include <cstdint>
 #include <ctime>
+#include <exception>
 #include <filesystem>
 #include <iomanip>
 #include <iostream>
 #include <optional>
+#include <set>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <system_error>
+#include <thread>
+#include <utility>
 #include <vector>
 
 namespace retort
 {
 namespace
 {
-std::filesystem::path resolve_root(const write_config &config) {
-    if (!config.source_directory.empty()) {
-        const std::filesystem::path src_path{config.source_directory};
-        if (src_path.is_absolute() || config.repository_root.empty()) {
-            return src_path;
-        }
-        return std::filesystem::path{config.repository_root} / src_path;
-    }
-    if (!config.repository_root.empty()) {
-        return std::filesystem::path{config.repository_root};
-    }
-    throw std::runtime_error("unable to resolve source root");
-}
-
 std::string iso8601_now() {
     const auto now = std::chrono::system_clock::now();
     const auto now_time_t = std::chrono::system_clock::to_time_t(now);
@@ -46,31 +48,441 @@ std::string iso8601_now() {
     return oss.str();
 }
 
-std::optional<std::string> read_repo_commit(const std::string &repo_root) {
-    if (repo_root.empty()) {
-        return std::nullopt;
+void write_meta(sqlite3 *db, const std::string &key, const std::string &value) {
+    sqlite3_stmt *stmt = nullptr;
+    const char *sql = "INSERT INTO meta(key, value) VALUES(?, ?) ON CONFLICT(key) DO UPDATE SET value=excluded.value";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("failed to prepare meta statement");
+    }
+    sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, value.c_str(), -1, SQLITE_TRANSIENT);
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        sqlite3_finalize(stmt);
+        throw std::runtime_error("failed to write meta");
+    }
+    sqlite3_finalize(stmt);
+}
+
+void set_fts_option(sqlite3 *db, std::string_view option, int value) {
+    std::string query = "INSERT INTO docs_fts(docs_fts, rank) VALUES('";
+    query.append(option).append("', ").append(std::to_string(value)).append(")");
+    if (sqlite3_exec(db, query.c_str(), nullptr, nullptr, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("failed to set fts option: " + std::string{option});
+    }
+}
+
+// The output file is always created from scratch, so the FTS segments are
+// left unmerged while loading (large hash flushes, no automerge) and merged
+// into a single b-tree by 'optimize' once every row is in.
+void begin_bulk_load(sqlite3 *db) {
+    set_fts_option(db, "hashsize", 64 * 1024 * 1024);
+    set_fts_option(db, "automerge", 0);
+    set_fts_option(db, "crisismerge", 64);
+}
+
+void finish_bulk_load(sqlite3 *db) {
+    if (sqlite3_exec(db, "INSERT INTO docs_fts(docs_fts) VALUES('optimize')", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("failed to optimize fts index");
+    }
+    set_fts_option(db, "automerge", 4);
+    set_fts_option(db, "crisismerge", 16);
+}
+
+void check_integrity(sqlite3 *db) {
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, "PRAGMA quick_check", -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("failed to prepare quick_check");
+    }
+    std::string result;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        const auto *text = reinterpret_cast<const char *>(sqlite3_column_text(stmt, 0));
+        result = text != nullptr ? text : "";
+    }
+    sqlite3_finalize(stmt);
+    if (result != "ok") {
+        throw std::runtime_error("index failed quick_check: " + result);
+    }
+}
+
+void sync_path(const std::filesystem::path &path, int flags) {
+    const int fd = open(path.c_str(), flags | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("failed to open for fsync: " + path.string());
+    }
+    const int rc = fsync(fd);
+    close(fd);
+    if (rc != 0) {
+        throw std::runtime_error("fsync failed: " + path.string());
+    }
+}
+
+void remove_index_files(const std::filesystem::path &path) {
+    std::error_code ec;
+    for (const char *suffix : {"", "-journal", "-wal", "-shm"}) {
+        std::filesystem::remove(path.string() + suffix, ec);
+    }
+}
+
+// Readers either keep the old inode or open the complete new file; they never
+// see a partially written index. Stale sidecar files of the old index are
+// dropped first so SQLite cannot replay them against the new one.
+void publish_index(const std::filesystem::path &temp_path, const std::filesystem::path &output_path) {
+    sync_path(temp_path, O_RDONLY);
+    std::error_code ec;
+    for (const char *suffix : {"-journal", "-wal", "-shm"}) {
+        std::filesystem::remove(output_path.string() + suffix, ec);
+    }
+    std::filesystem::rename(temp_path, output_path);
+    const auto parent = output_path.parent_path();
+    sync_path(parent.empty() ? std::filesystem::path{"."} : parent, O_RDONLY | O_DIRECTORY);
+}
+
+const char *fts_tokenizer_for(text_tokenizer tokenizer) {
+    return tokenizer == text_tokenizer::cjk ? cjk_tokenizer_name : fts_tokenizer_name;
+}
+
+// Byte size of the first count UTF-8 characters of term, or 0 when the term
+// is shorter than that.
+std::size_t utf8_prefix_size(std::string_view term, std::size_t count) {
+    std::size_t size = 0U;
+    for (std::size_t i = 0U; i < count; ++i) {
+        if (size == term.size()) {
+            return 0U;
+        }
+        ++size;
+        while (size < term.size() && (static_cast<unsigned char>(term[size]) & 0xC0U) == 0x80U) {
+            ++size;
+        }
+    }
+    return size;
+}
+
+// Stores the top hit_count hits of every 2- and 3-character prefix in the
+// vocabulary as ready-made hit JSON. They are evaluated by the memory engine,
+// which without prefix_fanout scores and snippets exactly like FTS5.
+void write_hot_prefixes(sqlite_database &database, std::size_t hit_count) {
+    auto *db = database.handle();
+    std::set<std::string> prefixes;
+    sqlite3_stmt *vocab = nullptr;
+    if (sqlite3_prepare_v2(db, "SELECT term FROM term_dictionary", -1, &vocab, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("failed to prepare vocabulary scan");
+    }
+    while (sqlite3_step(vocab) == SQLITE_ROW) {
+        const std::string_view term{reinterpret_cast<const char *>(sqlite3_column_text(vocab, 0)),
+                                    static_cast<std::size_t>(sqlite3_column_bytes(vocab, 0))};
+        for (const std::size_t count : {2U, 3U}) {
+            const auto size = utf8_prefix_size(term, count);
+            if (size != 0U) {
+                prefixes.emplace(term.substr(0U, size));
+            }
+        }
+    }
+    sqlite3_finalize(vocab);
+
+    const memory_index index{database};
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("failed to begin transaction");
     }
-    std::string command = "git -C '" + repo_root + "' rev-parse HEAD 2>/dev/null";
-    FILE *pipe = popen(command.c_str(), "r");
-    if (pipe == nullptr) {
-        return std::nullopt;
+    sqlite3_stmt *insert = nullptr;
+    if (sqlite3_prepare_v2(db, "INSERT INTO hot_prefixes(prefix, rank, hit) VALUES(?, ?, ?)", -1, &insert, nullptr) != SQLITE_OK) {
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        throw std::runtime_error("failed to prepare hot prefix insert");
     }
-    char buffer[256];
-    std::string output;
-    while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
-        output.append(buffer);
+    for (const auto &prefix : prefixes) {
+        const auto hits = index.search(prefix + "*", hit_count, 0U);
+        if (!hits.has_value()) {
+            continue;
+        }
+        for (std::size_t rank = 0U; rank < hits->size(); ++rank) {
+            const auto hit = to_json((*hits)[rank]);
+            sqlite3_reset(insert);
+            sqlite3_bind_text(insert, 1, prefix.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_int64(insert, 2, static_cast<sqlite3_int64>(rank));
+            sqlite3_bind_text(insert, 3, hit.c_str(), -1, SQLITE_STATIC);
+            if (sqlite3_step(insert) != SQLITE_DONE) {
+                sqlite3_finalize(insert);
+                sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+                throw std::runtime_error("failed to insert hot prefix row");
+            }
+        }
     }
-    const int status = pclose(pipe);
-    if (status != 0) {
-        return std::nullopt;
+    sqlite3_finalize(insert);
+    if (sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("failed to commit hot prefixes");
     }
-    while (!output.empty() && (output.back() == '\n' || output.back() == '\r')) {
-        output.pop_back();
+}
+
+// Builds a complete index file at path. Durability pragmas are off during the
+// build, which is safe because the file is only published once it is whole.
+void write_index_file(const std::filesystem::path &path,
+                      const std::vector<document_row> &documents,
+                      const std::optional<std::string> &repo_commit,
+                      const write_config &config) {
+    remove_index_files(path);
+    sqlite_database database{path.string()};
+    ensure_schema(database, config.prefix_index, fts_tokenizer_for(config.tokenizer));
+    if (config.trigram) {
+        ensure_trigram_schema(database);
     }
-    if (output.empty()) {
-        return std::nullopt;
+    auto *db = database.handle();
+
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("failed to begin transaction");
     }
-    return output;
+
+    try {
+        begin_bulk_load(db);
+
+        sqlite3_stmt *docs_stmt = nullptr;
+        const char *docs_sql =
+            "INSERT INTO docs(id, doc_id, url, format, title, tags, lang, updated_at, sha1, body)"
+            " VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+        if (sqlite3_prepare_v2(db, docs_sql, -1, &docs_stmt, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("failed to prepare docs statement");
+        }
+
+        sqlite3_stmt *fts_insert = nullptr;
+        const char *fts_insert_sql = "INSERT INTO docs_fts(rowid, title, body_tokens) VALUES(?, ?, ?)";
+        if (sqlite3_prepare_v2(db, fts_insert_sql, -1, &fts_insert, nullptr) != SQLITE_OK) {
+            sqlite3_finalize(docs_stmt);
+            throw std::runtime_error("failed to prepare fts insert");
+        }
+
+        // Bound buffers outlive every step, so they are bound without copies.
+        for (const auto &doc : documents) {
+            sqlite3_reset(docs_stmt);
+            sqlite3_bind_int64(docs_stmt, 1, doc.id);
+            sqlite3_bind_text(docs_stmt, 2, doc.doc_id.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(docs_stmt, 3, doc.url.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(docs_stmt, 4, doc.format.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(docs_stmt, 5, doc.title.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(docs_stmt, 6, doc.tags_json.c_str(), -1, SQLITE_STATIC);
+            if (doc.lang.empty()) {
+                sqlite3_bind_null(docs_stmt, 7);
+            }
+            else {
+                sqlite3_bind_text(docs_stmt, 7, doc.lang.c_str(), -1, SQLITE_STATIC);
+            }
+            sqlite3_bind_int64(docs_stmt, 8, doc.updated_at);
+            sqlite3_bind_text(docs_stmt, 9, doc.sha1.c_str(), -1, SQLITE_STATIC);
+            const auto body_blob = deflate_text(doc.body_tokens);
+            sqlite3_bind_blob(docs_stmt, 10, body_blob.data(), static_cast<int>(body_blob.size()), SQLITE_STATIC);
+            if (sqlite3_step(docs_stmt) != SQLITE_DONE) {
+                sqlite3_finalize(docs_stmt);
+                sqlite3_finalize(fts_insert);
+                throw std::runtime_error("failed to insert docs row");
+            }
+
+            sqlite3_reset(fts_insert);
+            sqlite3_bind_int64(fts_insert, 1, doc.id);
+            sqlite3_bind_text(fts_insert, 2, doc.title.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(fts_insert, 3, doc.body_tokens.c_str(), static_cast<int>(doc.body_tokens.size()), SQLITE_STATIC);
+            if (sqlite3_step(fts_insert) != SQLITE_DONE) {
+                sqlite3_finalize(docs_stmt);
+                sqlite3_finalize(fts_insert);
+                throw std::runtime_error("failed to insert fts row");
+            }
+        }
+
+        sqlite3_finalize(docs_stmt);
+        sqlite3_finalize(fts_insert);
+
+        finish_bulk_load(db);
+        database.exec("INSERT INTO docs_fts_title(docs_fts_title) VALUES('rebuild');");
+        database.exec("INSERT INTO docs_fts_title(docs_fts_title) VALUES('optimize');");
+        if (config.trigram) {
+            database.exec("INSERT INTO docs_fts_tri(docs_fts_tri) VALUES('rebuild');");
+            database.exec("INSERT INTO docs_fts_tri(docs_fts_tri) VALUES('optimize');");
+        }
+        write_term_dictionary(database);
+        write_spelling_index(database);
+        write_completions(database, config.ngram_size.value_or(0) > 1);
+        write_facet_bitmaps(database);
+
+        write_meta(db, "schema_version", std::to_string(current_schema_version));
+        write_meta(db, "digest_algorithm", "sha1");
+        write_meta(db, "doc_count", std::to_string(documents.size()));
+        write_meta(db, "next_id", std::to_string(documents.size() + 1U));
+        write_meta(db, "built_at", iso8601_now());
+        write_meta(db, "repo_commit", repo_commit.value_or("unknown"));
+        write_meta(db, "prefix_fanout", std::to_string(config.prefix_fanout));
+        write_meta(db, "prefix_index", format_prefix_index(config.prefix_index));
+        write_meta(db, "tokenizer", fts_tokenizer_for(config.tokenizer));
+        write_meta(db, "trigram", config.trigram ? "1" : "0");
+        write_meta(db, "hot_prefix_hits", std::to_string(config.hot_prefix_hits));
+
+        if (sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("failed to commit transaction");
+        }
+    }
+    catch (...) {
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        throw;
+    }
+
+    if (config.hot_prefix_hits > 0U) {
+        write_hot_prefixes(database, config.hot_prefix_hits);
+    }
+    database.exec("VACUUM;");
+    check_integrity(db);
+}
+
+// A segment is serialized from a finished SQLite build next to it, so its
+// terms and statistics are exactly what FTS5 sees for the same documents.
+void write_output_file(const std::filesystem::path &path,
+                       const std::vector<document_row> &documents,
+                       const std::optional<std::string> &repo_commit,
+                       const write_config &config) {
+    if (config.format == index_format::sqlite) {
+        write_index_file(path, documents, repo_commit, config);
+        return;
+    }
+    const std::filesystem::path staging{path.string() + ".sqlite"};
+    try {
+        write_index_file(staging, documents, repo_commit, config);
+        std::vector<std::uint8_t> image;
+        {
+            sqlite_database database{staging.string(), SQLITE_OPEN_READONLY};
+            image = build_segment(database);
+        }
+        remove_index_files(staging);
+        write_segment_file(path, image);
+    }
+    catch (...) {
+        remove_index_files(staging);
+        throw;
+    }
+}
+
+// Files are collected in path order, so ids follow doc_id order and stay
+// dense across rebuilds of the same tree.
+void assign_ids(std::vector<document_row> &documents) {
+    for (std::size_t i = 0U; i < documents.size(); ++i) {
+        documents[i].id = static_cast<std::int64_t>(i + 1U);
+    }
+}
+
+std::filesystem::path temp_path_for(const std::filesystem::path &path) {
+    return std::filesystem::path{path.string() + ".tmp-" + std::to_string(getpid())};
+}
+
+// Shard names carry the build, so a new build never overwrites the shards a
+// published manifest still lists.
+std::string make_build_id() {
+    const auto now = std::chrono::system_clock::now().time_since_epoch();
+    std::ostringstream oss;
+    oss << std::hex << std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+    return oss.str();
+}
+
+std::filesystem::path shard_path(const std::filesystem::path &output_path, const std::string &build_id, std::size_t index) {
+    auto name = output_path.stem().string() + "-" + build_id + "-" + std::to_string(index) + output_path.extension().string();
+    return output_path.parent_path() / name;
+}
+
+// The shards listed by the manifest currently at output_path; none when it
+// is missing, a plain index or unreadable.
+std::vector<std::filesystem::path> published_shards(const std::filesystem::path &output_path) {
+    std::error_code ec;
+    if (!std::filesystem::exists(output_path, ec)) {
+        return {};
+    }
+    try {
+        return read_shard_manifest(output_path).value_or(std::vector<std::filesystem::path>{});
+    }
+    catch (const std::exception &) {
+        return {};
+    }
+}
+
+// Runs after the new index is in place. Readers that already opened a retired
+// shard keep its inode until they reopen.
+void retire_shards(const std::vector<std::filesystem::path> &retired, const std::vector<std::filesystem::path> &kept) {
+    for (const auto &file : retired) {
+        if (std::find(kept.begin(), kept.end(), file) == kept.end()) {
+            remove_index_files(file);
+        }
+    }
+}
+
+// Shards are written concurrently under names unique to this build and only
+// then is the manifest at output_path swapped in, so a reader sees either the
+// previous build's shards or this one's, never a mix. The previous build's
+// shards are deleted after the swap.
+void build_shards(const std::filesystem::path &output_path,
+                  std::vector<document_row> documents,
+                  const std::optional<std::string> &repo_commit,
+                  const write_config &config) {
+    const auto shard_count = config.shard_count;
+    std::vector<std::vector<document_row>> shards(shard_count);
+    for (auto &doc : documents) {
+        shards[shard_for_doc(doc.doc_id, shard_count)].push_back(std::move(doc));
+    }
+
+    const auto build_id = make_build_id();
+    std::vector<std::filesystem::path> shard_files;
+    std::vector<std::filesystem::path> temp_files;
+    for (std::size_t i = 0U; i < shard_count; ++i) {
+        assign_ids(shards[i]);
+        shard_files.push_back(shard_path(output_path, build_id, i));
+        temp_files.push_back(temp_path_for(shard_files.back()));
+    }
+    const auto manifest_temp = temp_path_for(output_path);
+
+    try {
+        std::vector<std::exception_ptr> errors(shard_count);
+        std::vector<std::thread> workers;
+        workers.reserve(shard_count);
+        for (std::size_t i = 0U; i < shard_count; ++i) {
+            workers.emplace_back([&, i]() {
+                try {
+                    write_output_file(temp_files[i], shards[i], repo_commit, config);
+                }
+                catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            });
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        for (const auto &error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+
+        for (std::size_t i = 0U; i < shard_count; ++i) {
+            publish_index(temp_files[i], shard_files[i]);
+        }
+        write_shard_manifest(manifest_temp, shard_files);
+    }
+    catch (...) {
+        for (std::size_t i = 0U; i < shard_count; ++i) {
+            remove_index_files(temp_files[i]);
+            remove_index_files(shard_files[i]);
+        }
+        remove_index_files(manifest_temp);
+        throw;
+    }
+    const auto previous = published_shards(output_path);
+    publish_index(manifest_temp, output_path);
+    retire_shards(previous, shard_files);
+}
+}
+
+std::filesystem::path resolve_source_root(const write_config &config) {
+    if (!config.source_directory.empty()) {
+        const std::filesystem::path src_path{config.source_directory};
+        if (src_path.is_absolute() || config.repository_root.empty()) {
+            return src_path;
+        }
+        return std::filesystem::path{config.repository_root} / src_path;
+    }
+    if (!config.repository_root.empty()) {
+        return std::filesystem::path{config.repository_root};
+    }
+    throw std::runtime_error("unable to resolve source root");
 }
 
 std::filesystem::path resolve_output_file(const write_config &config) {
@@ -97,7 +509,7 @@ std::filesystem::path resolve_output_file(const write_config &config) {
         if (ec) {
             throw std::runtime_error("failed to create output directory: " + raw_path.string());
         }
-        raw_path /= "retort_index.sqlite";
+        raw_path /= config.format == index_format::segment ? "retort_index.seg" : "retort_index.sqlite";
     } else {
         const auto parent = raw_path.parent_path();
         if (!parent.empty()) {
@@ -111,38 +523,20 @@ std::filesystem::path resolve_output_file(const write_config &config) {
     return raw_path;
 }
 
-void write_meta(sqlite3 *db, const std::string &key, const std::string &value) {
-    sqlite3_stmt *stmt = nullptr;
-    const char *sql = "INSERT INTO meta(key, value) VALUES(?, ?) ON CONFLICT(key) DO UPDATE SET value=excluded.value";
-    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
-        throw std::runtime_error("failed to prepare meta statement");
-    }
-    sqlite3_bind_text(stmt, 1, key.c_str(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 2, value.c_str(), -1, SQLITE_TRANSIENT);
-    if (sqlite3_step(stmt) != SQLITE_DONE) {
-        sqlite3_finalize(stmt);
-        throw std::runtime_error("failed to write meta");
-    }
-    sqlite3_finalize(stmt);
-}
-
-void reset_table(sqlite3 *db, std::string_view table) {
-    std::string query = "DELETE FROM ";
-    query.append(table);
-    if (sqlite3_exec(db, query.c_str(), nullptr, nullptr, nullptr) != SQLITE_OK) {
-        throw std::runtime_error("failed to reset table");
-    }
-}
-}
-
 void build_index(const write_config &config) {
-    const auto root_path = resolve_root(config);
+    const auto root_path = resolve_source_root(config);
     const auto output_path = resolve_output_file(config);
     markdown_options options{};
     options.include_code_blocks = config.include_code_blocks;
     options.ngram_size = config.ngram_size;
     options.max_bytes = config.max_bytes;
 
+    std::optional<git_history> history;
+    if (!config.repository_root.empty()) {
+        history = git_history::load(config.repository_root);
+        options.history = &*history;
+    }
+
     const auto files = collect_markdown_files(root_path);
     if (files.empty()) {
         throw std::runtime_error("no markdown files found under " + root_path.string());
@@ -167,101 +561,23 @@ void build_index(const write_config &config) {
         throw std::runtime_error("no documents indexed (status=publish only)");
     }
 
-    std::error_code ec;
-    std::filesystem::remove(output_path, ec);
-
-    sqlite_database database{output_path};
-    ensure_schema(database);
-    auto *db = database.handle();
-
-    if (sqlite3_exec(db, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr) != SQLITE_OK) {
-        throw std::runtime_error("failed to begin transaction");
+    const auto commit_hash = history.has_value() ? history->head_commit() : std::nullopt;
+    if (config.shard_count > 1U) {
+        build_shards(output_path, std::move(documents), commit_hash, config);
+        return;
     }
 
+    assign_ids(documents);
+    const auto temp_path = temp_path_for(output_path);
+    const auto previous = published_shards(output_path);
     try {
-        reset_table(db, "docs");
-        reset_table(db, "docs_fts");
-
-        sqlite3_stmt *docs_stmt = nullptr;
-        const char *docs_sql =
-            "INSERT INTO docs(doc_id, url, format, title, tags, lang, updated_at, sha1)"
-            " VALUES(?, ?, ?, ?, ?, ?, ?, ?)"
-            " ON CONFLICT(doc_id) DO UPDATE SET"
-            " url=excluded.url, format=excluded.format, title=excluded.title,"
-            " tags=excluded.tags, lang=excluded.lang, updated_at=excluded.updated_at, sha1=excluded.sha1";
-        if (sqlite3_prepare_v2(db, docs_sql, -1, &docs_stmt, nullptr) != SQLITE_OK) {
-            throw std::runtime_error("failed to prepare docs statement");
-        }
-
-        sqlite3_stmt *fts_delete = nullptr;
-        const char *fts_delete_sql = "DELETE FROM docs_fts WHERE doc_id = ?";
-        if (sqlite3_prepare_v2(db, fts_delete_sql, -1, &fts_delete, nullptr) != SQLITE_OK) {
-            sqlite3_finalize(docs_stmt);
-            throw std::runtime_error("failed to prepare fts delete");
-        }
-
-        sqlite3_stmt *fts_insert = nullptr;
-        const char *fts_insert_sql = "INSERT INTO docs_fts(doc_id, title, body_tokens) VALUES(?, ?, ?)";
-        if (sqlite3_prepare_v2(db, fts_insert_sql, -1, &fts_insert, nullptr) != SQLITE_OK) {
-            sqlite3_finalize(docs_stmt);
-            sqlite3_finalize(fts_delete);
-            throw std::runtime_error("failed to prepare fts insert");
-        }
-
-        for (const auto &doc : documents) {
-            sqlite3_reset(docs_stmt);
-            sqlite3_clear_bindings(docs_stmt);
-            sqlite3_bind_text(docs_stmt, 1, doc.doc_id.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(docs_stmt, 2, doc.url.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(docs_stmt, 3, doc.format.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(docs_stmt, 4, doc.title.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(docs_stmt, 5, doc.tags_json.c_str(), -1, SQLITE_TRANSIENT);
-            if (doc.lang.empty()) {
-                sqlite3_bind_null(docs_stmt, 6);
-            }
-            else {
-                sqlite3_bind_text(docs_stmt, 6, doc.lang.c_str(), -1, SQLITE_TRANSIENT);
-            }
-            sqlite3_bind_int64(docs_stmt, 7, doc.updated_at);
-            sqlite3_bind_text(docs_stmt, 8, doc.sha1.c_str(), -1, SQLITE_TRANSIENT);
-            if (sqlite3_step(docs_stmt) != SQLITE_DONE) {
-                throw std::runtime_error("failed to insert docs row");
-            }
-
-            sqlite3_reset(fts_delete);
-            sqlite3_clear_bindings(fts_delete);
-            sqlite3_bind_text(fts_delete, 1, doc.doc_id.c_str(), -1, SQLITE_TRANSIENT);
-            if (sqlite3_step(fts_delete) != SQLITE_DONE) {
-                throw std::runtime_error("failed to delete existing fts row");
-            }
-
-            sqlite3_reset(fts_insert);
-            sqlite3_clear_bindings(fts_insert);
-            sqlite3_bind_text(fts_insert, 1, doc.doc_id.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(fts_insert, 2, doc.title.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(fts_insert, 3, doc.body_tokens.c_str(), -1, SQLITE_TRANSIENT);
-            if (sqlite3_step(fts_insert) != SQLITE_DONE) {
-                throw std::runtime_error("failed to insert fts row");
-            }
-        }
-
-        sqlite3_finalize(docs_stmt);
-        sqlite3_finalize(fts_delete);
-        sqlite3_finalize(fts_insert);
-
-        write_meta(db, "schema_version", "1");
-        write_meta(db, "doc_count", std::to_string(documents.size()));
-        write_meta(db, "built_at", iso8601_now());
-        const auto commit_hash = read_repo_commit(config.repository_root);
-        write_meta(db, "repo_commit", commit_hash.value_or("unknown"));
-
-        if (sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
-            throw std::runtime_error("failed to commit transaction");
-        }
+        write_output_file(temp_path, documents, commit_hash, config);
+        publish_index(temp_path, output_path);
     }
     catch (...) {
-        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        remove_index_files(temp_path);
         throw;
     }
+    retire_shards(previous, {});
 }
 }
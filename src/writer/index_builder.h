@@ -2,7 +2,12 @@
 
 #include "config/app_config.h"
 
+#include <filesystem>
+
 namespace retort
 {
+std::filesystem::path resolve_source_root(const write_config &config);
+std::filesystem::path resolve_output_file(const write_config &config);
+
 void build_index(const write_config &config);
 }
@@ -0,0 +1,561 @@
+#include "index_watcher.h"
+
+#include "index/document.h"
+#include "index/sqlite_database.h"
+#include "util/compression.h"
+#include "writer/facet_builder.h"
+#include "writer/index_builder.h"
+#include "writer/markdown_loader.h"
+#include "writer/vocabulary_builder.h"
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+namespace retort
+{
+namespace
+{
+// Quiet period that ends a burst of events, and the longest a change may
+// wait while events keep arriving.
+constexpr std::chrono::milliseconds debounce_delay{250};
+constexpr std::chrono::milliseconds max_batch_delay{1000};
+// How long the tree must stay quiet before the vocabulary tables catch up.
+// The server reads them only when it (re)opens the index, so they stay off
+// the batch path.
+constexpr std::chrono::milliseconds vocabulary_delay{5000};
+
+class statement
+{
+public:
+    statement(sqlite3 *db, const char *sql) {
+        if (sqlite3_prepare_v2(db, sql, -1, &stmt_, nullptr) != SQLITE_OK) {
+            throw std::runtime_error(std::string{"failed to prepare statement: "} + sqlite3_errmsg(db));
+        }
+    }
+    ~statement() {
+        sqlite3_finalize(stmt_);
+    }
+
+    statement(const statement &) = delete;
+    statement &operator=(const statement &) = delete;
+
+    sqlite3_stmt *reset() {
+        sqlite3_reset(stmt_);
+        sqlite3_clear_bindings(stmt_);
+        return stmt_;
+    }
+
+private:
+    sqlite3_stmt *stmt_ = nullptr;
+};
+
+struct stored_doc
+{
+    std::int64_t id = 0;
+    std::string sha1;
+    std::string title;
+    std::string body_tokens;
+};
+
+std::string column_string(sqlite3_stmt *stmt, int column) {
+    const auto *text = reinterpret_cast<const char *>(sqlite3_column_text(stmt, column));
+    return text != nullptr ? std::string{text, static_cast<std::size_t>(sqlite3_column_bytes(stmt, column))} : std::string{};
+}
+
+void step_done(sqlite3_stmt *stmt, const char *what) {
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        throw std::runtime_error(std::string{"failed to "} + what);
+    }
+}
+
+// Row-level upserts and deletes against a schema v2 index. External-content
+// FTS5 needs the old column values to remove a row, so they are read back
+// from docs before it changes.
+class incremental_writer
+{
+public:
+    explicit incremental_writer(sqlite3 *db)
+        : db_{db},
+          select_{db, "SELECT id, sha1, title, retort_inflate(body) FROM docs WHERE doc_id = ?"},
+          select_prefix_{db, "SELECT doc_id FROM docs WHERE doc_id > ? AND doc_id < ?"},
+          next_id_{db, "SELECT CAST(value AS INTEGER) FROM meta WHERE key = 'next_id'"},
+          advance_id_{db, "UPDATE meta SET value = CAST(? AS TEXT) WHERE key = 'next_id'"},
+          insert_doc_{db,
+                      "INSERT INTO docs(id, doc_id, url, format, title, tags, lang, updated_at, sha1, body)"
+                      " VALUES(?, ?, ?, ?, ?, ?, ?, ?, ?, ?)"},
+          update_doc_{db,
+                      "UPDATE docs SET url = ?, format = ?, title = ?, tags = ?, lang = ?, updated_at = ?, sha1 = ?, body = ?"
+                      " WHERE id = ?"},
+          delete_doc_{db, "DELETE FROM docs WHERE id = ?"},
+          fts_insert_{db, "INSERT INTO docs_fts(rowid, title, body_tokens) VALUES(?, ?, ?)"},
+          fts_delete_{db, "INSERT INTO docs_fts(docs_fts, rowid, title, body_tokens) VALUES('delete', ?, ?, ?)"}
+    {
+        // Ids only go up, so a running server never mistakes a new document
+        // for a deleted one in its startup facet bitmaps and recency array.
+        // Indexes written before meta.next_id start from their current
+        // highest id.
+        const char *sql =
+            "INSERT INTO meta(key, value) SELECT 'next_id', CAST(coalesce(max(id), 0) + 1 AS TEXT) FROM docs WHERE true"
+            " ON CONFLICT(key) DO NOTHING;";
+        if (sqlite3_exec(db, sql, nullptr, nullptr, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("failed to read next document id");
+        }
+        has_facets_ = has_table(db, "facet_bitmaps");
+        has_dictionary_ = has_table(db, "term_dictionary");
+        has_spelling_ = has_dictionary_ && has_table(db, "spelling_deletes");
+        has_completions_ = has_table(db, "completions");
+        if (has_table(db, "docs_fts_title")) {
+            title_insert_.emplace(db, "INSERT INTO docs_fts_title(rowid, title) VALUES(?, ?)");
+            title_delete_.emplace(db, "INSERT INTO docs_fts_title(docs_fts_title, rowid, title) VALUES('delete', ?, ?)");
+        }
+        if (has_table(db, "docs_fts_tri")) {
+            tri_insert_.emplace(db, "INSERT INTO docs_fts_tri(rowid, title, body_tokens) VALUES(?, ?, ?)");
+            tri_delete_.emplace(db, "INSERT INTO docs_fts_tri(docs_fts_tri, rowid, title, body_tokens) VALUES('delete', ?, ?, ?)");
+        }
+    }
+
+    // Returns false when the stored digest already matches.
+    bool upsert(const document_row &row) {
+        const auto existing = find(row.doc_id);
+        if (existing.has_value() && existing->sha1 == row.sha1) {
+            return false;
+        }
+        const auto body_blob = deflate_text(row.body_tokens);
+        std::int64_t id = 0;
+        if (existing.has_value()) {
+            id = existing->id;
+            delete_fts(*existing);
+            auto *stmt = update_doc_.reset();
+            sqlite3_bind_text(stmt, 1, row.url.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 2, row.format.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 3, row.title.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 4, row.tags_json.c_str(), -1, SQLITE_STATIC);
+            bind_lang(stmt, 5, row.lang);
+            sqlite3_bind_int64(stmt, 6, row.updated_at);
+            sqlite3_bind_text(stmt, 7, row.sha1.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_blob(stmt, 8, body_blob.data(), static_cast<int>(body_blob.size()), SQLITE_STATIC);
+            sqlite3_bind_int64(stmt, 9, id);
+            step_done(stmt, "update docs row");
+        }
+        else {
+            auto *id_stmt = next_id_.reset();
+            if (sqlite3_step(id_stmt) != SQLITE_ROW) {
+                throw std::runtime_error("failed to allocate document id");
+            }
+            id = sqlite3_column_int64(id_stmt, 0);
+            auto *advance = advance_id_.reset();
+            sqlite3_bind_int64(advance, 1, id + 1);
+            step_done(advance, "advance next document id");
+            auto *stmt = insert_doc_.reset();
+            sqlite3_bind_int64(stmt, 1, id);
+            sqlite3_bind_text(stmt, 2, row.doc_id.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 3, row.url.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 4, row.format.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 5, row.title.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 6, row.tags_json.c_str(), -1, SQLITE_STATIC);
+            bind_lang(stmt, 7, row.lang);
+            sqlite3_bind_int64(stmt, 8, row.updated_at);
+            sqlite3_bind_text(stmt, 9, row.sha1.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_blob(stmt, 10, body_blob.data(), static_cast<int>(body_blob.size()), SQLITE_STATIC);
+            step_done(stmt, "insert docs row");
+        }
+
+        write_fts(fts_insert_, id, row.title, row.body_tokens);
+        if (tri_insert_.has_value()) {
+            write_fts(*tri_insert_, id, row.title, row.body_tokens);
+        }
+        if (title_insert_.has_value()) {
+            write_title(*title_insert_, id, row.title);
+        }
+        return true;
+    }
+
+    bool remove(const std::string &doc_id) {
+        const auto existing = find(doc_id);
+        if (!existing.has_value()) {
+            return false;
+        }
+        delete_fts(*existing);
+        auto *stmt = delete_doc_.reset();
+        sqlite3_bind_int64(stmt, 1, existing->id);
+        step_done(stmt, "delete docs row");
+        return true;
+    }
+
+    // Removes every document below a directory that disappeared.
+    std::size_t remove_tree(const std::string &directory_id) {
+        const std::string lower = directory_id + '/';
+        const std::string upper = directory_id + static_cast<char>('/' + 1);
+        std::vector<std::string> doc_ids;
+        auto *stmt = select_prefix_.reset();
+        sqlite3_bind_text(stmt, 1, lower.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 2, upper.c_str(), -1, SQLITE_STATIC);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            doc_ids.push_back(column_string(stmt, 0));
+        }
+        std::size_t removed = 0U;
+        for (const auto &doc_id : doc_ids) {
+            removed += remove(doc_id) ? 1U : 0U;
+        }
+        return removed;
+    }
+
+    void refresh_meta() {
+        const char *sql =
+            "INSERT INTO meta(key, value)"
+            " SELECT 'doc_count', CAST(count(*) AS TEXT) FROM docs WHERE true"
+            " ON CONFLICT(key) DO UPDATE SET value = excluded.value;"
+            "INSERT INTO meta(key, value) VALUES('built_at', strftime('%Y-%m-%dT%H:%M:%SZ', 'now'))"
+            " ON CONFLICT(key) DO UPDATE SET value = excluded.value;";
+        if (sqlite3_exec(db_, sql, nullptr, nullptr, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("failed to update meta");
+        }
+    }
+
+    // The tables derived from docs that the index has; older indexes lack
+    // some of them. Facets follow every batch, the vocabulary only idle
+    // periods.
+    void refresh_facets(sqlite_database &database) const {
+        if (has_facets_) {
+            write_facet_bitmaps(database);
+        }
+    }
+
+    void refresh_vocabulary(sqlite_database &database, bool titles_only_completions) const {
+        const bool new_terms = has_dictionary_ && write_term_dictionary(database);
+        if (has_spelling_ && new_terms) {
+            write_spelling_index(database);
+        }
+        if (has_completions_) {
+            write_completions(database, titles_only_completions);
+        }
+    }
+
+private:
+    static void bind_lang(sqlite3_stmt *stmt, int index, const std::string &lang) {
+        if (lang.empty()) {
+            sqlite3_bind_null(stmt, index);
+        }
+        else {
+            sqlite3_bind_text(stmt, index, lang.c_str(), -1, SQLITE_STATIC);
+        }
+    }
+
+    std::optional<stored_doc> find(const std::string &doc_id) {
+        auto *stmt = select_.reset();
+        sqlite3_bind_text(stmt, 1, doc_id.c_str(), -1, SQLITE_STATIC);
+        if (sqlite3_step(stmt) != SQLITE_ROW) {
+            return std::nullopt;
+        }
+        stored_doc doc;
+        doc.id = sqlite3_column_int64(stmt, 0);
+        doc.sha1 = column_string(stmt, 1);
+        doc.title = column_string(stmt, 2);
+        doc.body_tokens = column_string(stmt, 3);
+        return doc;
+    }
+
+    static bool has_table(sqlite3 *db, const char *name) {
+        statement lookup{db, "SELECT 1 FROM sqlite_master WHERE name = ?"};
+        auto *stmt = lookup.reset();
+        sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+        return sqlite3_step(stmt) == SQLITE_ROW;
+    }
+
+    // Inserts and external-content deletes take the same (rowid, title,
+    // body_tokens) bindings.
+    static void write_fts(statement &target, std::int64_t id, const std::string &title, const std::string &body_tokens) {
+        auto *stmt = target.reset();
+        sqlite3_bind_int64(stmt, 1, id);
+        sqlite3_bind_text(stmt, 2, title.c_str(), -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, body_tokens.c_str(), static_cast<int>(body_tokens.size()), SQLITE_STATIC);
+        step_done(stmt, "write fts row");
+    }
+
+    static void write_title(statement &target, std::int64_t id, const std::string &title) {
+        auto *stmt = target.reset();
+        sqlite3_bind_int64(stmt, 1, id);
+        sqlite3_bind_text(stmt, 2, title.c_str(), -1, SQLITE_STATIC);
+        step_done(stmt, "write title row");
+    }
+
+    void delete_fts(const stored_doc &doc) {
+        write_fts(fts_delete_, doc.id, doc.title, doc.body_tokens);
+        if (tri_delete_.has_value()) {
+            write_fts(*tri_delete_, doc.id, doc.title, doc.body_tokens);
+        }
+        if (title_delete_.has_value()) {
+            write_title(*title_delete_, doc.id, doc.title);
+        }
+    }
+
+    sqlite3 *db_;
+    statement select_;
+    statement select_prefix_;
+    statement next_id_;
+    statement advance_id_;
+    statement insert_doc_;
+    statement update_doc_;
+    statement delete_doc_;
+    statement fts_insert_;
+    statement fts_delete_;
+    std::optional<statement> tri_insert_;
+    std::optional<statement> tri_delete_;
+    std::optional<statement> title_insert_;
+    std::optional<statement> title_delete_;
+    bool has_facets_ = false;
+    bool has_dictionary_ = false;
+    bool has_spelling_ = false;
+    bool has_completions_ = false;
+};
+
+bool is_markdown(const std::filesystem::path &path) {
+    const auto ext = path.extension();
+    return ext == ".md" || ext == ".mdx";
+}
+
+// Recursive inotify watch set; new directories are added as they appear.
+class tree_watch
+{
+public:
+    explicit tree_watch(const std::filesystem::path &root)
+        : fd_{inotify_init1(IN_NONBLOCK | IN_CLOEXEC)},
+          root_{root}
+    {
+        if (fd_ < 0) {
+            throw std::runtime_error("inotify_init1 failed: " + std::string{std::strerror(errno)});
+        }
+        add_tree(root);
+    }
+    ~tree_watch() {
+        close(fd_);
+    }
+
+    tree_watch(const tree_watch &) = delete;
+    tree_watch &operator=(const tree_watch &) = delete;
+
+    int fd() const noexcept {
+        return fd_;
+    }
+
+    void add_tree(const std::filesystem::path &directory) {
+        add_directory(directory);
+        std::error_code ec;
+        for (std::filesystem::recursive_directory_iterator it{directory, ec}, end; !ec && it != end; it.increment(ec)) {
+            if (it->is_directory(ec)) {
+                add_directory(it->path());
+            }
+        }
+    }
+
+    // Drains queued events into the set of paths that need re-indexing.
+    void drain(std::set<std::filesystem::path> &changed) {
+        alignas(inotify_event) char buffer[64 * 1024];
+        while (true) {
+            const ssize_t length = read(fd_, buffer, sizeof(buffer));
+            if (length <= 0) {
+                if (length < 0 && errno != EAGAIN && errno != EINTR) {
+                    throw std::runtime_error("inotify read failed: " + std::string{std::strerror(errno)});
+                }
+                return;
+            }
+            for (ssize_t offset = 0; offset < length;) {
+                const auto *event = reinterpret_cast<const inotify_event *>(buffer + offset);
+                offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+                handle_event(*event, changed);
+            }
+        }
+    }
+
+private:
+    void add_directory(const std::filesystem::path &directory) {
+        const auto mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+        const int wd = inotify_add_watch(fd_, directory.c_str(), mask);
+        if (wd < 0) {
+            std::cerr << "watch failed for " << directory << ": " << std::strerror(errno) << '\n';
+            return;
+        }
+        directories_[wd] = directory;
+    }
+
+    void handle_event(const inotify_event &event, std::set<std::filesystem::path> &changed) {
+        // Events were dropped, so every file may have changed.
+        if ((event.mask & IN_Q_OVERFLOW) != 0U) {
+            changed.insert(root_);
+            return;
+        }
+        if ((event.mask & IN_IGNORED) != 0U) {
+            directories_.erase(event.wd);
+            return;
+        }
+        const auto it = directories_.find(event.wd);
+        if (it == directories_.end() || event.len == 0U) {
+            return;
+        }
+        const auto path = it->second / event.name;
+        const bool is_directory = (event.mask & IN_ISDIR) != 0U;
+        if (is_directory) {
+            if ((event.mask & (IN_CREATE | IN_MOVED_TO)) != 0U) {
+                add_tree(path);
+            }
+            changed.insert(path);
+            return;
+        }
+        // A bare IN_CREATE is followed by IN_CLOSE_WRITE once the file is written.
+        if (is_markdown(path) && (event.mask & IN_CREATE) == 0U) {
+            changed.insert(path);
+        }
+    }
+
+    int fd_;
+    std::filesystem::path root_;
+    std::unordered_map<int, std::filesystem::path> directories_;
+};
+
+std::size_t apply_changes(sqlite_database &database,
+                          incremental_writer &writer,
+                          const std::filesystem::path &root_path,
+                          const markdown_options &options,
+                          const std::set<std::filesystem::path> &changed) {
+    std::size_t applied = 0U;
+    const auto index_file = [&](const std::filesystem::path &file) {
+        const auto doc_id = std::filesystem::relative(file, root_path).generic_string();
+        try {
+            const auto converted = convert_markdown(root_path, file, options);
+            if (converted.has_value()) {
+                applied += writer.upsert(*converted) ? 1U : 0U;
+            }
+            else {
+                applied += writer.remove(doc_id) ? 1U : 0U;
+            }
+        }
+        catch (const std::exception &ex) {
+            std::cerr << "skip file " << file << ": " << ex.what() << '\n';
+        }
+    };
+
+    database.exec("BEGIN IMMEDIATE;");
+    try {
+        for (const auto &path : changed) {
+            std::error_code ec;
+            if (std::filesystem::is_directory(path, ec)) {
+                for (const auto &file : collect_markdown_files(path)) {
+                    index_file(file);
+                }
+            }
+            else if (std::filesystem::is_regular_file(path, ec)) {
+                index_file(path);
+            }
+            else {
+                const auto doc_id = std::filesystem::relative(path, root_path).generic_string();
+                applied += writer.remove(doc_id) ? 1U : 0U;
+                applied += writer.remove_tree(doc_id);
+            }
+        }
+        if (applied > 0U) {
+            writer.refresh_meta();
+            writer.refresh_facets(database);
+        }
+        database.exec("COMMIT;");
+    }
+    catch (...) {
+        database.exec("ROLLBACK;");
+        throw;
+    }
+    return applied;
+}
+
+void refresh_vocabulary(sqlite_database &database, const incremental_writer &writer, const markdown_options &options) {
+    database.exec("BEGIN IMMEDIATE;");
+    try {
+        writer.refresh_vocabulary(database, options.ngram_size.value_or(0) > 1);
+        database.exec("COMMIT;");
+    }
+    catch (...) {
+        database.exec("ROLLBACK;");
+        throw;
+    }
+}
+}
+
+void watch_index(const write_config &config) {
+    const auto root_path = resolve_source_root(config);
+    const auto output_path = resolve_output_file(config);
+    markdown_options options{};
+    options.include_code_blocks = config.include_code_blocks;
+    options.ngram_size = config.ngram_size;
+    options.max_bytes = config.max_bytes;
+
+    // Watches go up before the build, so a file saved while it runs is
+    // picked up by the first batch instead of waiting for its next change.
+    tree_watch watch{root_path};
+    build_index(config);
+
+    sqlite_database database{output_path.string()};
+    // WAL lets a serving process keep reading while batches commit.
+    database.exec("PRAGMA journal_mode=WAL;");
+    database.exec("PRAGMA synchronous=NORMAL;");
+    sqlite3_busy_timeout(database.handle(), 5000);
+    incremental_writer writer{database.handle()};
+
+    std::cout << "retort write watching " << root_path.string() << std::endl;
+
+    using clock = std::chrono::steady_clock;
+    std::set<std::filesystem::path> changed;
+    clock::time_point first_change{};
+    bool vocabulary_stale = false;
+    while (true) {
+        int timeout_ms = vocabulary_stale ? static_cast<int>(vocabulary_delay.count()) : -1;
+        if (!changed.empty()) {
+            const auto deadline = first_change + max_batch_delay;
+            const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now());
+            timeout_ms = static_cast<int>(std::max<std::int64_t>(0, std::min(remaining, debounce_delay).count()));
+        }
+
+        pollfd descriptor{watch.fd(), POLLIN, 0};
+        const int ready = poll(&descriptor, 1, timeout_ms);
+        if (ready < 0 && errno != EINTR) {
+            throw std::runtime_error("poll failed: " + std::string{std::strerror(errno)});
+        }
+        if (ready > 0) {
+            const bool was_empty = changed.empty();
+            watch.drain(changed);
+            if (was_empty && !changed.empty()) {
+                first_change = clock::now();
+            }
+            if (clock::now() - first_change < max_batch_delay) {
+                continue;
+            }
+        }
+        if (changed.empty()) {
+            if (ready == 0 && vocabulary_stale) {
+                refresh_vocabulary(database, writer, options);
+                vocabulary_stale = false;
+            }
+            continue;
+        }
+
+        const auto applied = apply_changes(database, writer, root_path, options, changed);
+        if (applied > 0U) {
+            std::cout << "reindexed " << applied << " document(s)" << std::endl;
+            vocabulary_stale = true;
+        }
+        changed.clear();
+    }
+}
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "config/app_config.h"
+
+namespace retort
+{
+// Builds the index like build_index(), then keeps it in sync with its source
+// tree by re-indexing changed Markdown files in place. The tree is watched
+// from before the build starts. Runs until interrupted.
+void watch_index(const write_config &config);
+}
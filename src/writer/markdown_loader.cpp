@@ -1,11 +1,13 @@
 #include "markdown_loader.h"
 
+#include "util/sha1.h"
+#include "util/text_normalizer.h"
+
 #include <algorithm>
 #include <cctype>
 #include <chrono>
 #include <filesystem>
 #include <fstream>
-#include <functional>
 #include <optional>
 #include <sstream>
 #include <stdexcept>
@@ -102,7 +104,15 @@ std::string tags_to_json(const std::vector<std::string> &tags) {
     return oss.str();
 }
 
-std::string read_file(const std::filesystem::path &path, std::size_t max_bytes) {
+struct file_contents
+{
+    std::string bytes;
+    std::string digest;
+};
+
+// Reads in fixed chunks so the SHA-1 of the raw bytes is computed in the
+// same pass; the digest is stable across hosts and toolchains.
+file_contents read_file(const std::filesystem::path &path, std::size_t max_bytes) {
     std::ifstream stream{path, std::ios::binary};
     if (!stream) {
         throw std::runtime_error("failed to open file: " + path.string());
@@ -113,10 +123,24 @@ std::string read_file(const std::filesystem::path &path, std::size_t max_bytes)
         throw std::runtime_error("file exceeds max bytes: " + path.string());
     }
     stream.seekg(0, std::ios::beg);
-    std::string contents(size, '\0');
-    if (size > 0U) {
-        stream.read(contents.data(), static_cast<std::streamsize>(size));
+
+    constexpr std::size_t chunk_size = 64U * 1024U;
+    file_contents contents;
+    contents.bytes.resize(size);
+    sha1_hasher hasher;
+    std::size_t offset = 0U;
+    while (offset < size) {
+        const auto chunk = std::min(chunk_size, size - offset);
+        stream.read(contents.bytes.data() + offset, static_cast<std::streamsize>(chunk));
+        const auto got = static_cast<std::size_t>(stream.gcount());
+        if (got == 0U) {
+            break;
+        }
+        hasher.update(contents.bytes.data() + offset, got);
+        offset += got;
     }
+    contents.bytes.resize(offset);
+    contents.digest = hasher.finish_hex();
     return contents;
 }
 
@@ -266,53 +290,8 @@ std::string strip_mdx(const std::string &body) {
     return output.str();
 }
 
-std::string collapse_punctuation(const std::string &input) {
-    std::string output;
-    output.reserve(input.size());
-    bool last_space = false;
-    for (unsigned char uc : input) {
-        if (std::isalnum(uc)) {
-            output.push_back(static_cast<char>(std::tolower(uc)));
-            last_space = false;
-        }
-        else if (static_cast<unsigned char>(uc) >= 128U) {
-            output.push_back(static_cast<char>(uc));
-            last_space = false;
-        }
-        else {
-            if (!last_space) {
-                output.push_back(' ');
-                last_space = true;
-            }
-        }
-    }
-    return output;
-}
-
-std::string collapse_spaces(const std::string &input) {
-    std::string output;
-    output.reserve(input.size());
-    bool last_space = true;
-    for (char ch : input) {
-        if (std::isspace(static_cast<unsigned char>(ch))) {
-            if (!last_space) {
-                output.push_back(' ');
-                last_space = true;
-            }
-        }
-        else {
-            output.push_back(ch);
-            last_space = false;
-        }
-    }
-    if (!output.empty() && output.back() == ' ') {
-        output.pop_back();
-    }
-    return output;
-}
-
 std::string build_tokens(const std::string &input, const std::optional<int> &ngram_size) {
-    const auto collapsed = collapse_spaces(collapse_punctuation(input));
+    const auto collapsed = normalize_text(input);
     if (!ngram_size.has_value() || *ngram_size <= 1) {
         return collapsed;
     }
@@ -352,25 +331,13 @@ std::int64_t file_timestamp(const std::filesystem::path &path) {
     const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(system_time.time_since_epoch());
     return seconds.count();
 }
-
-std::string compute_digest(const document_row &row) {
-    std::string buffer;
-    buffer.reserve(row.title.size() + row.body_tokens.size());
-    buffer.append(row.title);
-    buffer.push_back('\n');
-    buffer.append(row.body_tokens);
-    const auto value = std::hash<std::string>{}(buffer);
-    std::ostringstream oss;
-    oss << std::hex << value;
-    return oss.str();
-}
 }
 
 std::optional<document_row> convert_markdown(const std::filesystem::path &root_path,
     const std::filesystem::path &file_path,
     const markdown_options &options) {
     const auto contents = read_file(file_path, options.max_bytes);
-    const auto [frontmatter, body_raw] = split_frontmatter(contents);
+    const auto [frontmatter, body_raw] = split_frontmatter(contents.bytes);
     const auto it_draft = frontmatter.find("draft");
     if (it_draft != frontmatter.end()) {
         const auto value = trim_copy(it_draft->second);
@@ -426,9 +393,13 @@ std::optional<document_row> convert_markdown(const std::filesystem::path &root_p
         row.tags_json = "[]";
     }
 
-    row.updated_at = file_timestamp(file_path);
+    std::optional<std::int64_t> committed_at;
+    if (options.history != nullptr) {
+        committed_at = options.history->committed_at(file_path);
+    }
+    row.updated_at = committed_at.has_value() ? *committed_at : file_timestamp(file_path);
     row.body_tokens = build_tokens(body, options.ngram_size);
-    row.sha1 = compute_digest(row);
+    row.sha1 = contents.digest;
     return row;
 }
 
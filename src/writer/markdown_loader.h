@@ -2,6 +2,7 @@
 
 #include "index/document.h"
 #include "config/app_config.h"
+#include "writer/git_history.h"
 
 #include <filesystem>
 #include <optional>
@@ -14,6 +15,8 @@ struct markdown_options
     bool include_code_blocks = false;
     std::optional<int> ngram_size;
     std::size_t max_bytes = 1024U * 1024U;
+    // When set, updated_at is the file's last commit time instead of its mtime.
+    const git_history *history = nullptr;
 };
 
 std::optional<document_row> convert_markdown(const std::filesystem::path &root_path,
@@ -0,0 +1,115 @@
+#include "vocabulary_builder.h"
+
+#include "search/spelling_index.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace retort
+{
+namespace
+{
+std::int64_t count_rows(sqlite3 *db, const char *table) {
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, (std::string{"SELECT count(*) FROM "} + table).c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("failed to prepare row count");
+    }
+    const auto count = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int64(stmt, 0) : 0;
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+// Scratch table for the rows a table should hold. It is emptied rather than
+// dropped, since dropping a real table fails while the watcher still has a
+// statement open.
+void start_fresh(sqlite_database &database) {
+    database.exec("CREATE TEMP TABLE IF NOT EXISTS fresh(term TEXT PRIMARY KEY, value INTEGER NOT NULL) WITHOUT ROWID;");
+    database.exec("DELETE FROM temp.fresh;");
+}
+
+// Brings table(term, value_column) in line with temp.fresh(term, value),
+// deleting, inserting and updating only the rows that differ, so a watcher
+// batch that touches a few terms writes a few rows. Returns whether the set
+// of terms changed.
+bool sync_from_fresh(sqlite_database &database, const std::string &table, const std::string &value_column) {
+    auto *db = database.handle();
+    database.exec("DELETE FROM " + table + " WHERE term NOT IN (SELECT term FROM temp.fresh);");
+    const bool removed = sqlite3_changes(db) > 0;
+    const auto before = count_rows(db, table.c_str());
+    database.exec("INSERT INTO " + table + "(term, " + value_column + ") SELECT term, value FROM temp.fresh WHERE true"
+                  " ON CONFLICT(term) DO UPDATE SET " + value_column + " = excluded." + value_column +
+                  " WHERE " + value_column + " <> excluded." + value_column + ";");
+    const bool added = count_rows(db, table.c_str()) != before;
+    database.exec("DELETE FROM temp.fresh;");
+    return removed || added;
+}
+}
+
+bool write_term_dictionary(sqlite_database &database) {
+    database.exec("CREATE VIRTUAL TABLE temp.docs_vocab USING fts5vocab(main, docs_fts, row);");
+    start_fresh(database);
+    database.exec("INSERT INTO temp.fresh(term, value) SELECT term, doc FROM temp.docs_vocab;");
+    database.exec("DROP TABLE temp.docs_vocab;");
+    return sync_from_fresh(database, "term_dictionary", "doc_freq");
+}
+
+// Fills completions with the words /suggest offers: every title word and
+// every body word found in at least two documents, weighted by document
+// frequency with a title counting ten times a body. Byte n-grams appended by
+// --ngram are not words, so with them only titles are used.
+void write_completions(sqlite_database &database, bool titles_only) {
+    database.exec("CREATE VIRTUAL TABLE temp.docs_vocab_col USING fts5vocab(main, docs_fts, col);");
+    start_fresh(database);
+    database.exec(std::string{
+        "INSERT INTO temp.fresh(term, value)"
+        " SELECT term, SUM(CASE col WHEN 'title' THEN doc * 10 ELSE doc END) FROM temp.docs_vocab_col"} +
+        (titles_only ? " WHERE col = 'title'" : "") +
+        " GROUP BY term HAVING SUM(doc) >= 2 OR SUM(col = 'title') > 0;");
+    database.exec("DROP TABLE temp.docs_vocab_col;");
+    sync_from_fresh(database, "completions", "weight");
+}
+
+// Fills spelling_deletes from term_dictionary. Term ids are positions in the
+// dictionary's byte order; CJK and other non-ASCII terms, whose byte edits
+// mean little, and terms too short to correct are left out.
+void write_spelling_index(sqlite_database &database) {
+    auto *db = database.handle();
+    database.exec("DELETE FROM spelling_deletes;");
+    std::map<std::string, std::vector<std::uint32_t>> variants;
+    sqlite3_stmt *terms = nullptr;
+    if (sqlite3_prepare_v2(db, "SELECT term FROM term_dictionary ORDER BY term", -1, &terms, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("failed to prepare term dictionary scan");
+    }
+    for (std::uint32_t id = 0U; sqlite3_step(terms) == SQLITE_ROW; ++id) {
+        const std::string_view term{reinterpret_cast<const char *>(sqlite3_column_text(terms, 0)),
+                                    static_cast<std::size_t>(sqlite3_column_bytes(terms, 0))};
+        if (term.size() < 3U || std::any_of(term.begin(), term.end(), [](unsigned char ch) { return ch >= 0x80U; })) {
+            continue;
+        }
+        for (auto &variant : spelling_variants(term, max_spelling_edits)) {
+            variants[std::move(variant)].push_back(id);
+        }
+    }
+    sqlite3_finalize(terms);
+
+    sqlite3_stmt *insert = nullptr;
+    if (sqlite3_prepare_v2(db, "INSERT INTO spelling_deletes(variant, term_ids) VALUES(?, ?)", -1, &insert, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("failed to prepare spelling insert");
+    }
+    for (const auto &[variant, ids] : variants) {
+        sqlite3_reset(insert);
+        sqlite3_bind_text(insert, 1, variant.data(), static_cast<int>(variant.size()), SQLITE_STATIC);
+        sqlite3_bind_blob(insert, 2, ids.data(), static_cast<int>(ids.size() * sizeof(std::uint32_t)), SQLITE_STATIC);
+        if (sqlite3_step(insert) != SQLITE_DONE) {
+            sqlite3_finalize(insert);
+            throw std::runtime_error("failed to insert spelling row");
+        }
+    }
+    sqlite3_finalize(insert);
+}
+}
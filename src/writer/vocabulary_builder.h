@@ -0,0 +1,23 @@
+#pragma once
+
+#include "index/sqlite_database.h"
+
+namespace retort
+{
+// The tables derived from the docs_fts vocabulary. Each replaces its rows,
+// so the watcher can bring them up to date once its batches settle; all run
+// inside the caller's transaction.
+
+// term_dictionary: every term with its document frequency, which the
+// server loads for fuzzy matching and prefix caps. Returns whether the set
+// of terms changed, rather than only their frequencies.
+bool write_term_dictionary(sqlite_database &database);
+
+// spelling_deletes, from term_dictionary, which must be written first. It
+// refers to terms by position, so it only goes stale when the set of terms
+// changes.
+void write_spelling_index(sqlite_database &database);
+
+// completions: the words /suggest offers. titles_only for --ngram indexes.
+void write_completions(sqlite_database &database, bool titles_only);
+}